@@ -39,6 +39,15 @@ class Partition
   Partition(UInt_t n);
   Partition(UInt_t n, UInt_t k);
   Partition &operator++();
+  /*!
+   * Jump to the last partition, in the order of the generators, that
+   * has the same number of parts, agrees in the first `i` distinct
+   * parts and multiplicities, and whose other parts are all larger
+   * than `parts()[i]`. Together with the current partition, all
+   * partitions in between share these properties. Requires `1 <= i <
+   * distinct_parts()`.
+   */
+  void skip(UInt_t i);
   bool operator==(const Partition &) const;
   const vec &mult() const noexcept
   { return c; }
@@ -48,12 +57,20 @@ class Partition
   { return h; }
   UInt_t number() const noexcept
   { return n; }
+  /// Smallest index `i` such that `mult()[i]` or `parts()[i]` changed in the last update
+  const UInt_t &first_modified() const noexcept
+  { return f; }
+  /// Number of parts counting multiplicity; i.e., `\sum_i c_i`
+  const UInt_t &total_parts() const noexcept
+  { return nparts; }
 
  private:
   vec c;     /// multiplicity
   vec y;     /// part
   const UInt_t n; /// Partition of n
   UInt_t h;  /// number of distinct parts
+  UInt_t f;  /// first modified index
+  UInt_t nparts; /// number of parts
 };
 
 /*!
@@ -80,6 +97,8 @@ class Partition
  * 2*1 + 2*2
  * 4*1 + 1*2
  * 6*1
+ *
+ * Note that partitions with fewer parts come first.
  */
 class AbstractPartitionGenerator : public std::iterator<std::input_iterator_tag, Partition>
 {
@@ -100,6 +119,10 @@ class AbstractPartitionGenerator : public std::iterator<std::input_iterator_tag,
   /// Increment to next partition. Fails if already done; i.e. bool(this) == false
   AbstractPartitionGenerator &operator++();
 
+  /// Skip ahead as in `Partition::skip`. The next increment leaves the skipped range.
+  void skip(UInt_t i)
+  { p.skip(i); }
+
  protected:
   AbstractPartitionGenerator(const Partition &);
   virtual bool final_partition() const = 0;
@@ -118,15 +141,24 @@ class KPartitionGenerator : public AbstractPartitionGenerator
   virtual bool final_partition() const override;
 };
 
-/// Generate all partitions of `n`.
+/*!
+ * Generate all partitions of `n`, or only those into at most `kmax`
+ * parts.
+ *
+ * The number of parts never decreases, so the partitions into exactly
+ * `k` parts for `k = 1...kmax` are visited one after the other in a
+ * single pass; use `Partition::total_parts()` to tell them apart.
+ */
 class PartitionGenerator : public AbstractPartitionGenerator
 {
  public:
   PartitionGenerator(UInt_t n);
+  PartitionGenerator(UInt_t n, UInt_t kmax);
 
   PartitionGenerator &operator++();
  protected:
   virtual bool final_partition() const override;
+  const UInt_t kmax;
 };
 
 std::ostream &operator<<(std::ostream &, const Partition &);
@@ -2,6 +2,10 @@
 
 #pragma once
 
+#include <functional>
+#include <string>
+#include <vector>
+
 namespace squares
 {
 
@@ -23,4 +27,220 @@ namespace squares
 double cumulative(const double Tobs, const unsigned N);
 double pvalue(const double Tobs, const unsigned N);
 
+/*!
+ * Distributes independent pieces of work, for example over the
+ * threads of the caller's pool.
+ *
+ * Every function that computes partition sums takes an `Executor`,
+ * `openmp()` by default: the overloads of `cumulative` and `pvalue`,
+ * `cumulatives`, `log_pvalue`, `density`, `is_significant`,
+ * `resumable_cumulative`, `cumulative_shard`, `approx_cumulative`,
+ * `approx_pvalue`, `Delta` for many `Tobs`, `Monitor`,
+ * `CumulativeInterpolant`, and the Monte Carlo functions. Only
+ * `full_correction` and `pvalue_auto` always use `openmp()`.
+ */
+class Executor
+{
+ public:
+  virtual ~Executor() = default;
+
+  /*!
+   * Call `task(i)` for `i = 0...n-1` and return when all calls have
+   * finished. The calls may run concurrently and in any order.
+   */
+  virtual void parallel_for(unsigned n, const std::function<void(unsigned)> &task) = 0;
+};
+
+/// Run all tasks in the calling thread
+Executor &serial();
+
+/// Run the tasks in an OpenMP parallel region; the default
+Executor &openmp();
+
+/*!
+ * Compute the natural log of the p value `P(T >= Tobs | N)`.
+ *
+ * `pvalue` is `1 - cumulative` and cannot resolve values below about
+ * 1e-16. This sums the complementary \chi^2 probabilities of every
+ * partition directly, so there is no cancellation and tiny p values
+ * keep their full relative precision. It takes about as long as
+ * `cumulative(Tobs, N)`.
+ *
+ * The \chi^2 tail probabilities come from GSL in `double`, so the
+ * result is `-inf` once they underflow for `Tobs` above about 1400.
+ */
+double log_pvalue(const double Tobs, const unsigned N, Executor &executor = openmp());
+
+/*!
+ * Same as `cumulative(Tobs, N)` but let `executor` distribute the
+ * work instead of opening an OpenMP parallel region. Use `serial()`
+ * if the caller is parallel already.
+ */
+double cumulative(const double Tobs, const unsigned N, Executor &executor);
+double pvalue(const double Tobs, const unsigned N, Executor &executor);
+
+/*!
+ * Decide whether the p value `P(T >= Tobs | N)` is below `alpha`
+ * without computing it to full precision.
+ *
+ * Every r starts with cheap lower and upper bounds on its contribution
+ * to the cumulative. The r with the most uncertainty per partition
+ * are computed first, and the walk stops as soon as the bounds on the
+ * p value lie on one side of `alpha`. Unless the p value is close to
+ * `alpha`, this visits only a small fraction of all partitions.
+ *
+ * For `alpha < 1e-10`, the decision is based on `log_pvalue`.
+ *
+ * @arg lower, upper If not null, set to the bounds on the p value
+ * when the decision was made.
+ * @arg executor Distributes each round of exact computations, see `cumulative`
+ */
+bool is_significant(const double Tobs, const unsigned N, const double alpha,
+                    double *lower = nullptr, double *upper = nullptr, Executor &executor = openmp());
+
+/// Floating-point type for the sums over partitions
+enum class Precision
+{
+    /// `double`, relative error below 1e-12 for `N <= 100`
+    fast,
+    /// `double` with compensated summation, within a few ulp of `extended`
+    compensated,
+    /// `long double`, the default
+    extended
+};
+
+/*!
+ * Same as `cumulative(Tobs, N)` with a choice of precision.
+ *
+ * On x86, `long double` arithmetic runs on the x87 unit. `double` is
+ * faster but its range is smaller, so if any weight could underflow,
+ * `extended` is used anyway.
+ */
+double cumulative(const double Tobs, const unsigned N, const Precision precision, Executor &executor = openmp());
+
+/// The cumulative and its derivatives with respect to `Tobs`
+struct Density
+{
+    /// F(Tobs | N)
+    double F;
+    /// f = dF / dTobs, the density of `T`
+    double f;
+    /// f' = d^2F / dTobs^2, NaN if not computed
+    double df;
+};
+
+/*!
+ * Compute the cumulative, the density, and optionally its derivative
+ * in one pass over the partitions.
+ *
+ * The derivative of each partition's weight only needs the \chi^2
+ * densities for the same parts, so this costs little more than
+ * `cumulative(Tobs, N)`, and `F` is identical to it.
+ *
+ * @arg second Compute `f'` as well
+ * @arg executor Distributes the blocks of fixed `r`, see `cumulative`
+ */
+Density density(const double Tobs, const unsigned N, const bool second = false, Executor &executor = openmp());
+
+/*!
+ * Compute the cumulative for every number of trials `n = 1...N` at
+ * once, `F(Tobs | n)` is at index `n`, index 0 is unused.
+ *
+ * The sums over partitions don't depend on `n`, so this costs about
+ * as much as `cumulative(Tobs, N)` alone.
+ */
+std::vector<double> cumulatives(const double Tobs, const unsigned N, Executor &executor = openmp());
+
+/*!
+ * Compute the cumulative but skip blocks of partitions whose total
+ * contribution is guaranteed to be less than `tolerance`.
+ *
+ * This pays off for large `N` where the partitions of `r` close to
+ * `N` are numerous but contribute very little. Checking for subtrees
+ * of partitions to skip is only done for the `r` where a good part
+ * of the contribution can be skipped, so this is never noticeably
+ * slower than `cumulative(Tobs, N)`.
+ *
+ * @arg tolerance Maximum neglected mass, for example 1e-12. 0 for the exact result.
+ * @arg bound If not null, the rigorous upper bound on the neglected
+ * mass is stored here. The exact value lies in `[result, result + *bound]`.
+ */
+double cumulative(const double Tobs, const unsigned N, const double tolerance, double *bound = nullptr,
+                  Executor &executor = openmp());
+
+/*!
+ * Same as `cumulative(Tobs, N)` but save the partial sums of every
+ * completed `r` to the file `checkpoint` at most every `interval`
+ * seconds and once at the end.
+ *
+ * If `checkpoint` exists, it has to belong to the same `Tobs` and `N`
+ * and only the missing `r` are computed. So a computation that is
+ * killed can be restarted with the same arguments. The `r` are
+ * computed in parallel, so it loses the last `interval` seconds plus
+ * every `r` in progress, up to one per thread of `executor`. The file
+ * stores the bit patterns of the `long double` sums, the result is
+ * identical to an uninterrupted run.
+ *
+ * Throws `std::runtime_error` if `checkpoint` cannot be read, written,
+ * or belongs to a different computation.
+ */
+double resumable_cumulative(const double Tobs, const unsigned N, const std::string &checkpoint,
+                            const double interval = 600, Executor &executor = openmp());
+
+/*!
+ * Assign every `r = 1...N` to one of `nshards` shards such that the
+ * shards need similar time. The assignment is deterministic, the
+ * shard of `r` is at index `r`.
+ *
+ * Each `r` is computed as a whole, so no shard can finish faster than
+ * the most expensive single `r`, about 6% of the total for `N = 100`
+ * and 5% for `N = 150`. Beyond roughly 15-20 shards, more shards only
+ * add idle ones.
+ */
+std::vector<unsigned> shards(const unsigned N, const unsigned nshards);
+
+/*!
+ * Compute only the `r` that belong to `shard` out of `nshards` and
+ * write their partial sums to `output` in the format of
+ * `resumable_cumulative`.
+ *
+ * Run all shards, possibly in different processes or on different
+ * nodes, then combine the outputs with `merge_shards`. See `shards`
+ * for the limit on the useful number of shards.
+ *
+ * Throws `std::invalid_argument` unless `Tobs > 0`, `N > 0`, and
+ * `shard < nshards`.
+ */
+void cumulative_shard(const double Tobs, const unsigned N, const unsigned shard, const unsigned nshards,
+                      const std::string &output, Executor &executor = openmp());
+
+/*!
+ * Combine the output files of all shards into `cumulative(Tobs, N)`.
+ * The result is identical to a computation in one process.
+ *
+ * Throws `std::runtime_error` if the files belong to different
+ * computations or if any `r` is missing or present twice.
+ *
+ * @arg Tobs If not null, set to the `Tobs` found in the files.
+ * @arg N If not null, set to the `N` found in the files.
+ */
+double merge_shards(const std::vector<std::string> &inputs, double *Tobs = nullptr, unsigned *N = nullptr);
+
+/// Largest `N` for which `cumulative_tabulated` is available.
+constexpr unsigned max_tabulated_N = 40;
+
+/*!
+ * Same as `cumulative(Tobs, N)` but for a small `N <= max_tabulated_N`
+ * and faster if called repeatedly with the same `N`.
+ *
+ * The sum over `r`, `M`, and the partitions is flattened on the first
+ * call for each `N` into a table of coefficients and powers of
+ * `P(\chi^2 < Tobs | y)` that is kept for the lifetime of the
+ * program. Evaluating for another `Tobs` is then one loop over
+ * products without any partition generator, `exp`, or `log`.
+ *
+ * Throws `std::invalid_argument` if `N` is out of range.
+ */
+double cumulative_tabulated(const double Tobs, const unsigned N);
+
 }
\ No newline at end of file
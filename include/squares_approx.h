@@ -19,6 +19,14 @@
 // SOFTWARE.
 #pragma once
 
+#include "squares.h"
+
+#include <cstddef>
+#include <future>
+#include <map>
+#include <mutex>
+#include <vector>
+
 namespace squares
 {
 
@@ -32,15 +40,48 @@ double approx_cumulative(const double Tobs,
                          const unsigned N,
                          const double n,
                          double epsrel = EPSREL,
-                         double epsabs = EPSABS);
+                         double epsabs = EPSABS,
+                         Executor &executor = openmp());
 double approx_pvalue(const double Tobs,
                      const unsigned N,
                      const double n,
                      double epsrel = EPSREL,
-                     double epsabs = EPSABS);
+                     double epsabs = EPSABS,
+                     Executor &executor = openmp());
+
+/**
+ * F(Tobs | N_1 + N_2 + ...) for chunks of possibly different lengths
+ * `N_i`. Evaluates F(Tobs | N_i) exactly, once for every distinct
+ * length, and joins the chunks one at a time with
+ * `Delta(Tobs, N_1 + ... + N_{i-1}, N_i)`.
+ */
+double approx_cumulative(const double Tobs,
+                         const std::vector<unsigned> &chunks,
+                         double epsrel = EPSREL,
+                         double epsabs = EPSABS,
+                         Executor &executor = openmp());
+double approx_pvalue(const double Tobs,
+                     const std::vector<unsigned> &chunks,
+                     double epsrel = EPSREL,
+                     double epsabs = EPSABS,
+                     Executor &executor = openmp());
+
+/**
+ * Split `Ntotal` into the fewest chunks of at most `Nmax` whose
+ * lengths differ by at most one; the longer ones come first.
+ */
+std::vector<unsigned> chunks(const unsigned Ntotal, const unsigned Nmax);
 
 /**
  * Compute \Delta correction term.
+ *
+ * h and H are sums of \chi^2 densities and cumulatives, and the
+ * convolution of two \chi^2 distributions is another one, so the
+ * integral of h * H is a finite double sum of \chi^2 cumulatives in
+ * closed form. These follow from a few special functions by
+ * recurrences in the degrees of freedom, and the result is accurate to
+ * rounding for any `Tobs`. `epsrel` and `epsabs` are not needed and
+ * only kept for compatibility.
  */
 double Delta(const double Tobs,
              const unsigned Nl,
@@ -48,22 +89,172 @@ double Delta(const double Tobs,
              double epsrel = EPSREL,
              double epsabs = EPSABS);
 
+/**
+ * Compute the \Delta correction term for every value in `Tobs` at
+ * once, for example to tabulate it. The values are distributed by
+ * `executor`. Each value is the same as from the scalar `Delta`,
+ * including 0 for `Tobs <= 0`.
+ */
+std::vector<double> Delta(const std::vector<double> &Tobs,
+                          const unsigned Nl,
+                          const unsigned Nr,
+                          double epsrel = EPSREL,
+                          double epsabs = EPSABS,
+                          Executor &executor = openmp());
+
+/**
+ * F(x | N) for many nearby x from few calls to `cumulative`.
+ *
+ * The x axis is cut into panels of width `width`, built on first use:
+ * F is computed at 16 Chebyshev points, and the panel is halved until
+ * the last two Chebyshev coefficients sum to less than `tolerance`.
+ * Evaluating takes a barycentric interpolation on one panel, so the
+ * range extends lazily to wherever F is needed. Share one object
+ * across calls, and across threads, to reuse the panels. Threads
+ * build different cells concurrently; a thread that needs a cell
+ * being built by another waits for it instead of building it again.
+ */
+class CumulativeInterpolant
+{
+ public:
+  /// `executor` computes each call to `cumulative`
+  explicit CumulativeInterpolant(unsigned N, double tolerance = 1e-12, double width = 2,
+                                 Executor &executor = openmp());
+
+  CumulativeInterpolant(const CumulativeInterpolant &) = delete;
+  CumulativeInterpolant &operator=(const CumulativeInterpolant &) = delete;
+
+  /// F(x | N) for `x > 0` with an absolute error of about `tolerance`
+  double operator()(const double x);
+
+  unsigned N() const noexcept
+  { return n; }
+
+  /// Number of calls to `cumulative` so far
+  std::size_t nodes() const;
+
+ private:
+  struct Panel
+  {
+    double a, b;
+    std::vector<double> F;
+  };
+
+  /// Panels of one cell of width `width` in ascending order
+  using Cell = std::vector<Panel>;
+
+  /// Append the panels on `[a, b]` to `cell`, return the number of calls to `cumulative`
+  std::size_t build(const double a, const double b, Cell &cell) const;
+
+  const unsigned n;
+  const double tolerance, width;
+  Executor &executor;
+  /// guards `cells` and `ncalls` but is not held while building
+  mutable std::mutex mutex;
+  /// by the index of the cell, `floor(x / width)`
+  std::map<double, std::shared_future<Cell>> cells;
+  std::size_t ncalls;
+};
+
+/**
+ * Triangles that `full_correction` integrates over, saved from one
+ * call to warm-start the next. Empty for a cold start.
+ */
+struct Subdivision
+{
+    /// x and y of the three vertices in units of `Tobs`, six values per triangle
+    std::vector<double> regions;
+    /// evaluations of the integrand in the last call
+    unsigned evaluations = 0;
+};
+
 /**
  * Compute full correction w/o factoring out the cumulative.
  *
- * The 2D numerical integral is done by hcubature, which interprets
- * the relative and absolute precision `epsrel` and
- * `epsabs`. Expensive calls to `runs_cumulative` can be done once up
- * front and in the 2D integration, a linear interpolation is used in
- * place of `runs_cumulative` if the number of interpolation points
- * `ninterp >= 2`.
+ * The 2D numerical integral over the triangle `x, y <= Tobs <= x + y`
+ * is adaptive until the estimated error is below the relative and
+ * absolute precision `epsrel` or `epsabs`. The triangle is bisected
+ * and integrated with Grundmann-Moeller rules of degree 7 and 5; the
+ * \chi^2 singularities of h at its vertices `(Tobs, 0)` and `(0, Tobs)`
+ * are removed by a substitution, and if `Nl == Nr`, only the half
+ * `y <= x` is integrated. Expensive calls to `runs_cumulative` can be
+ * done once up front and in the 2D integration, a linear interpolation
+ * is used in place of `runs_cumulative` if the number of interpolation
+ * points `ninterp >= 2`. The triangles then start out between the
+ * interpolation points, so none contains a kink.
+ *
+ * In a scan over `Tobs`, `Nl`, or `Nr`, pass the same `warm` to every
+ * call. The integrand changes smoothly between neighboring points, so
+ * the subdivision of the domain that one call ends with is a good
+ * start for the next, and little or no refinement is needed.
  */
 double full_correction(const double Tobs,
                        const unsigned Nl,
                        const unsigned Nr,
                        double epsrel = EPSREL,
                        double epsabs = EPSABS,
-                       unsigned ninterp = 0);
+                       unsigned ninterp = 0,
+                       Subdivision *warm = nullptr);
+
+/**
+ * Same as `full_correction` but take F(x | Nl + Nr) from `F`, which
+ * can be reused for other `Tobs`.
+ *
+ * Throws `std::invalid_argument` unless `F.N() == Nl + Nr`.
+ */
+double full_correction(const double Tobs,
+                       const unsigned Nl,
+                       const unsigned Nr,
+                       CumulativeInterpolant &F,
+                       double epsrel = EPSREL,
+                       double epsabs = EPSABS,
+                       Subdivision *warm = nullptr);
+
+/// How `pvalue_auto` computed its result
+struct AutoChoice
+{
+    /// Length of the exactly computed chunk, `Ntotal` if not approximated
+    unsigned N;
+    /// Number of chunks, `Ntotal / N`
+    double n;
+    /// Upper bound on the absolute error, 0 if exact
+    double error;
+    /// Heuristic error extrapolated from the change of the result with
+    /// the chunk length, assuming it decreases like 1/N. Not a bound. 0
+    /// if exact or for the first chunk length tried
+    double extrapolated;
+    /// Predicted run time in seconds
+    double time;
+    /// Does the estimated error meet the tolerance?
+    bool converged;
+};
+
+/**
+ * The p value for `Ntotal` trials, computed exactly if that is
+ * predicted to take less than `time_budget` seconds, else by the
+ * split-runs approximation with the shortest chunk whose estimated
+ * error is below `tolerance`.
+ *
+ * The run time of the exact cumulative is predicted from the number
+ * of partitions to visit, the number of threads, and a calibration
+ * run on first use. The error of the approximation is estimated from
+ * the bounds F(T) Delta <= correction <= F(2T) Delta of joining two
+ * chunks, multiplied by the number of joins. Only this bound is
+ * compared to `tolerance`. If no chunk meets the tolerance within the
+ * budget, the most accurate one is used and `choice->converged` is
+ * false. As the bound does not shrink for longer chunks, the change of
+ * the result from the previous chunk length is extrapolated assuming
+ * the error decreases like 1/N and reported as
+ * `choice->extrapolated`, which is often much smaller but not
+ * guaranteed.
+ *
+ * @arg choice If not null, filled with what was done.
+ */
+double pvalue_auto(const double Tobs,
+                   const unsigned Ntotal,
+                   const double tolerance = 1e-6,
+                   const double time_budget = 10,
+                   AutoChoice *choice = nullptr);
 
 double h(const double chisq, const unsigned N);
 double H(const double a, const double b, const unsigned N);
@@ -0,0 +1,123 @@
+// Copyright 2018 Frederik Beaujean <beaujean@mpp.mpg.de>
+
+#pragma once
+
+#include "squares.h"
+
+#include <functional>
+#include <vector>
+
+namespace squares
+{
+
+/*!
+ * The SQUARES statistic of one sequence of standardized residuals
+ * `z_i = (x_i - mu_i) / sigma_i`; i.e., the largest sum of `z_i^2` over
+ * runs of consecutive positive `z_i`.
+ */
+double statistic(const double *z, const unsigned N);
+
+/*!
+ * The statistic of `nexp` sequences at once. The residual of bin `i` in
+ * sequence `k` is `z[i * nexp + k]`, so the loop over sequences is
+ * innermost and vectorizes.
+ *
+ * @arg T Output, at least `nexp` elements.
+ */
+void statistic(const double *z, const unsigned N, const unsigned nexp, double *T);
+
+/// Shift of every bin in units of its uncertainty for a Gaussian bump
+std::vector<double> gaussian_bump(const unsigned N, const double amplitude, const double center, const double width);
+
+/*!
+ * Fill `shift` with the signal of pseudo experiment `k` in units of
+ * the uncertainty, for example to inject at a random position. To be
+ * reproducible, the result should only depend on `k`.
+ *
+ * The signal is called concurrently from several threads, each with
+ * its own `shift`, so it must be thread-safe.
+ */
+using Signal = std::function<void(unsigned long k, std::vector<double> &shift)>;
+
+/*!
+ * Simulate `nexp` pseudo experiments with standard normal noise plus
+ * the signal and return `T` of each.
+ *
+ * Experiments are generated in batches with independent random
+ * streams derived from `seed` and the batch number, so the result
+ * only depends on `seed`, not on the executor or number of threads.
+ *
+ * Throws `std::invalid_argument` if the signal does not fill `N` bins.
+ * An exception thrown by the signal is passed on to the caller.
+ */
+std::vector<double> simulate(const std::vector<double> &shift, const unsigned long nexp,
+                             const unsigned long seed = 0, Executor &executor = openmp());
+std::vector<double> simulate(const unsigned N, const Signal &signal, const unsigned long nexp,
+                             const unsigned long seed = 0, Executor &executor = openmp());
+
+/*!
+ * The value of `T` at which the p value `1 - F(T)` drops to `alpha`,
+ * found by bisection to the relative precision `epsrel`.
+ *
+ * @arg F The cumulative for the number of bins of interest, for
+ * example a lambda around `cumulative`, `approx_cumulative`, or
+ * `std::ref` to a `CumulativeInterpolant`.
+ */
+double critical_value(const std::function<double(double)> &F, const double alpha, const double epsrel = 1e-6);
+
+/*!
+ * Power versus threshold: the fraction of `T` at or above each
+ * critical value of `F` for the significance levels `alpha`.
+ *
+ * The critical values are only resolved up to the spacing of the
+ * simulated `T`, so `F` is called only about `log2(T.size())` times per
+ * `alpha`, at values of `T`.
+ */
+std::vector<double> power(const std::vector<double> &T,
+                          const std::function<double(double)> &F,
+                          const std::vector<double> &alpha);
+
+/// Monte Carlo estimate of a probability
+struct Estimate
+{
+    double value;
+    /// Standard error
+    double error;
+};
+
+/*!
+ * Estimate the p value `P(T >= Tobs | N)` by importance sampling, for
+ * tiny p values where `1 - cumulative` cancels and plain Monte Carlo
+ * rarely produces a single experiment above `Tobs`.
+ *
+ * Each experiment shifts the residuals of a run of consecutive bins
+ * with random length and position and is weighted with the likelihood
+ * ratio of the null to the mixture over all lengths and positions. The
+ * relative error depends only weakly on the p value.
+ *
+ * @arg tilt Shift of the residuals in the run such that its sum of
+ * squares is `tilt^2 * Tobs` on average. Values slightly above 1 may
+ * reduce the error for very small p values.
+ */
+Estimate importance_pvalue(const double Tobs, const unsigned N, const unsigned long nexp,
+                           const double tilt = 1, const unsigned long seed = 0,
+                           Executor &executor = openmp());
+
+/*!
+ * Estimate the p value `P(T >= Tobs | N)` by randomized quasi Monte
+ * Carlo. The residuals of `npoints` pseudo experiments are taken from
+ * a Sobol sequence in `N` dimensions, mapped through the inverse
+ * normal cumulative. This is repeated for `nreplicas` independent
+ * scramblings of the sequence; the result is the mean and the error
+ * is estimated from the spread.
+ *
+ * The points fill the space more evenly than random numbers. For the
+ * same total number of experiments, the variance is typically 2-10
+ * times smaller than with `simulate`, more so for small `N` and
+ * moderate p values. Best with `npoints` a power of two.
+ */
+Estimate qmc_pvalue(const double Tobs, const unsigned N, const unsigned long npoints,
+                    const unsigned nreplicas = 16, const unsigned long seed = 0,
+                    Executor &executor = openmp());
+
+}
@@ -0,0 +1,98 @@
+// Copyright 2018 Frederik Beaujean <beaujean@mpp.mpg.de>
+
+#pragma once
+
+#include "squares_approx.h"
+
+#include <vector>
+
+namespace squares
+{
+
+/*!
+ * Follow the SQUARES statistic and its p value while observations
+ * arrive one at a time.
+ *
+ * Each observation updates the largest \chi^2 of any run of
+ * consecutive successes. As long as `Tobs` does not change, the
+ * partition sums for the previous `N` are kept and only the few
+ * missing ones are added for `N + 1`. If the new observation
+ * increases `Tobs`, everything is recomputed.
+ *
+ * Beyond `Nexact` observations, the monitor switches to
+ * `approx_cumulative(Tobs, Nexact, N / Nexact)` and keeps
+ * `F(Tobs | Nexact)` and `Delta` until `Tobs` changes.
+ */
+class Monitor
+{
+ public:
+  /*!
+   * @arg Nexact The largest number of observations for which the
+   * cumulative is computed exactly.
+   * @arg epsrel, epsabs The precision of the split-runs approximation.
+   * @arg executor Distributes the partition sums, see `cumulative`
+   */
+  explicit Monitor(unsigned Nexact = 80, double epsrel = EPSREL, double epsabs = EPSABS,
+                   Executor &executor = openmp());
+
+  /*!
+   * Add the next observation `x` with expectation `mu` and
+   * uncertainty `sigma`.
+   *
+   * @return The p value of all observations so far.
+   */
+  double add(const double x, const double mu = 0, const double sigma = 1);
+
+  /// Number of observations
+  unsigned N() const noexcept
+  { return n; }
+
+  /// Largest \chi^2 of any run of consecutive successes
+  double Tobs() const noexcept
+  { return T; }
+
+  /// Index of the first observation in the run that defines `Tobs`
+  unsigned run_begin() const noexcept
+  { return best_begin; }
+
+  /// One past the index of the last observation in the run that defines `Tobs`
+  unsigned run_end() const noexcept
+  { return best_end; }
+
+  /// Is the cumulative currently computed with the split-runs approximation?
+  bool approximate() const noexcept
+  { return n > Nexact; }
+
+  double cumulative() const noexcept
+  { return F; }
+
+  double pvalue() const noexcept
+  { return 1 - F; }
+
+ private:
+  void update();
+
+  const unsigned Nexact;
+  const double epsrel, epsabs;
+  Executor &executor;
+
+  unsigned n;
+  double T;
+  unsigned best_begin, best_end;
+
+  // the current run of successes
+  double chi2;
+  unsigned begin;
+
+  double F;
+
+  // partition sums of the exact cumulative for `Tsums`
+  double Tsums;
+  std::vector<std::vector<long double>> sums;
+
+  // `F(Tsplit | Nexact)` and `Delta(Tsplit, Nexact, Nexact)`
+  double Tsplit;
+  double Fsplit, Dsplit;
+};
+
+}
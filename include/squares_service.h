@@ -0,0 +1,138 @@
+// Copyright 2018 Frederik Beaujean <beaujean@mpp.mpg.de>
+
+#pragma once
+
+#include "squares.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace squares
+{
+
+/*!
+ * A single request to the p-value service.
+ *
+ * `n` is only used for `approx_cumulative`; i.e., F(Tobs | n*N), and
+ * ignored otherwise.
+ */
+struct Query
+{
+    enum Kind { cdf = 'c', pval = 'p', approx = 'a' };
+
+    Kind kind;
+    double Tobs;
+    unsigned N;
+    double n;
+};
+
+bool operator<(const Query &, const Query &);
+
+/// Evaluate a query in the current process on `executor`, no caching.
+double evaluate(const Query &, Executor &executor = openmp());
+
+/*!
+ * Fixed number of worker threads that run queued tasks in FIFO order.
+ *
+ * The workers are started in the constructor and joined in the
+ * destructor after all queued tasks have been run.
+ *
+ * As an `Executor`, the calling thread works on the loop as well, so
+ * `parallel_for` may be called from within a task without deadlock.
+ */
+class ThreadPool : public Executor
+{
+ public:
+  explicit ThreadPool(unsigned nthreads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  void submit(std::function<void()> task);
+  void parallel_for(unsigned n, const std::function<void(unsigned)> &task) override;
+  unsigned size() const noexcept
+  { return workers.size(); }
+
+ private:
+  void work();
+
+  std::vector<std::thread> workers;
+  std::queue<std::function<void()>> tasks;
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool stop;
+};
+
+/*!
+ * Cache the results of queries with a least-recently-used eviction policy.
+ *
+ * Misses are evaluated on the pool, which also distributes the sums
+ * over partitions of each query. If an identical query is already
+ * being evaluated, the caller waits for that result instead of
+ * starting a second evaluation.
+ */
+class QueryCache
+{
+ public:
+  QueryCache(std::size_t capacity, ThreadPool &pool);
+
+  /// Start all queries at once, then wait for the results in order.
+  std::vector<double> operator()(const std::vector<Query> &queries);
+  double operator()(const Query &q)
+  { return (*this)(std::vector<Query>{q}).front(); }
+
+  std::size_t size() const;
+  std::size_t hits() const;
+  std::size_t misses() const;
+
+ private:
+  std::shared_future<double> lookup(const Query &q);
+  void store(const Query &q, double value);
+
+  using Entry = std::pair<Query, double>;
+
+  const std::size_t capacity;
+  ThreadPool &pool;
+  mutable std::mutex mutex;
+  /// most recently used in front
+  std::list<Entry> lru;
+  std::map<Query, std::list<Entry>::iterator> index;
+  std::map<Query, std::shared_future<double>> in_flight;
+  std::size_t nhits, nmisses;
+};
+
+/*!
+ * Listen on the Unix domain socket `path` and answer queries from a
+ * `QueryCache` until a client sends the `quit` command.
+ *
+ * Connections are handled by as many threads as the pool has
+ * workers; further clients wait until one is free.
+ *
+ * An existing socket file at `path` is replaced.
+ *
+ * The run time grows quickly with N, so a request with a query for
+ * more than `max_N` observations, or with a non-finite number, is
+ * answered with an error.
+ */
+void serve(const std::string &path, std::size_t capacity = 10000, unsigned nthreads = 0, unsigned max_N = 100);
+
+/// Send a batch of queries to the server listening on `path`.
+std::vector<double> remote(const std::string &path, const std::vector<Query> &queries);
+
+/// Ask the server listening on `path` to shut down.
+void shutdown(const std::string &path);
+
+}
@@ -31,7 +31,9 @@ Partition::Partition(UInt_t n) :
     c(n + 1, 0),
     y(n + 1, 0),
     n(n),
-    h(1)
+    h(1),
+    f(1),
+    nparts(1)
 {
     assert(n > 0);
 
@@ -47,7 +49,9 @@ Partition::Partition(UInt_t n, UInt_t k) :
     y(k + 1, 0),
     // also the index of the largest part
     n(n),
-    h(0)
+    h(0),
+    f(1),
+    nparts(k)
 {
     assert(n > 0);
     assert(k > 0);
@@ -116,6 +120,14 @@ Partition &Partition::operator++()
         --i;
     }
 
+    // everything below `i` stays as it is
+    f = (i == 0) ? 1 : i;
+
+    // For given number of parts, the last partition is the one where
+    // all parts differ by at most one. The next one has one more part.
+    if (y[h] - y[1] <= 1)
+        ++nparts;
+
     // update current part when it equals 1
     if (c[i] == 1)
     {
@@ -159,6 +171,39 @@ Partition &Partition::operator++()
     return *this;
 }
 
+void Partition::skip(UInt_t i)
+{
+    assert(i >= 1);
+    assert(i < h);
+
+    // remainder and number of parts beyond i
+    Int_t r = 0;
+    Int_t m = 0;
+    for (auto l = i + 1; l <= h; ++l)
+    {
+        r += c[l] * y[l];
+        m += c[l];
+    }
+
+    // In the order of the generator, the last partition with the same
+    // beginning has the remainder distributed as evenly as possible:
+    // r = (m - e) * q + e * (q + 1).
+    const Int_t q = r / m;
+    const Int_t e = r % m;
+    assert(q > y[i]);
+
+    y[i + 1] = q;
+    c[i + 1] = m - e;
+    h = i + 1;
+    if (e > 0)
+    {
+        y[i + 2] = q + 1;
+        c[i + 2] = e;
+        h = i + 2;
+    }
+    f = i + 1;
+}
+
 bool Partition::operator==(const Partition &other) const
 {
     if (n != other.n || h != other.h)
@@ -209,8 +254,15 @@ bool KPartitionGenerator::final_partition() const
 }
 
 PartitionGenerator::PartitionGenerator(UInt_t n) :
-    AbstractPartitionGenerator(Partition(n))
+    PartitionGenerator(n, n)
+{
+}
+
+PartitionGenerator::PartitionGenerator(UInt_t n, UInt_t kmax) :
+    AbstractPartitionGenerator(Partition(n)),
+    kmax(std::min(n, kmax))
 {
+    assert(kmax > 0);
 }
 
 PartitionGenerator &PartitionGenerator::operator++()
@@ -221,7 +273,8 @@ PartitionGenerator &PartitionGenerator::operator++()
 
 bool PartitionGenerator::final_partition() const
 {
-    return UInt_t(p.mult()[1]) == p.number();
+    // same criterion as for k partitions
+    return p.total_parts() == kmax && p.parts()[p.distinct_parts()] - p.parts()[1] <= 1;
 }
 
 std::ostream &operator<<(std::ostream &out, const Partition &p)
@@ -1,26 +1,81 @@
 // Copyright 2018 Frederik Beaujean <beaujean@mpp.mpg.de>
 
 #include "squares.h"
-#include "partitions.h"
+#include "squares_detail.h"
 
 #include <gsl/gsl_cdf.h>
 
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <queue>
 
-// use ldouble for higher precision when adding lots of numbers
-using ldouble = long double;
+namespace squares
+{
+namespace detail
+{
 
 namespace
 {
 static std::vector<ldouble> log_factorial;
+// cumulative may be called from several threads at once
+static std::mutex log_factorial_mutex;
+
+/// Sum the weights of all partitions of `r` into exactly `M` parts
+template<class Weight>
+ldouble block_sum(unsigned r, unsigned M, const Weight &weight)
+{
+    ldouble res = 0;
+    for (partitions::KPartitionGenerator g(r, M); g; ++g)
+    {
+        auto w = Weight::one();
+        for (auto l = 1u; l <= g->distinct_parts(); ++l)
+            w = weight(w, g->parts()[l], g->mult()[l]);
+        res += weight.linear(w);
+    }
+    return res;
+}
+
+/// Log of the bound U(r, M) on the contribution of the (r, M) block, see `prune`
+ldouble log_block_bound(const unsigned N, const unsigned r, const unsigned M,
+                        const std::vector<ldouble> &log_cumulative,
+                        const std::vector<ldouble> &log_factorial)
+{
+    const ldouble logpow2N1 = (N <= 63) ? log((1ul << N) - 1) : N * log(2);
+    return log_factorial[N - r + 1] - log_factorial[N - r + 1 - M] - logpow2N1
+           + log_factorial[r - 1] - log_factorial[M - 1] - log_factorial[r - M] - log_factorial[M]
+           + M * log_cumulative[1];
+}
+
+template<class Weight>
+void extend_blocks(const unsigned N, const Weight &weight, Sums &sums, Executor &executor)
+{
+    sums.resize(N + 1);
+
+    executor.parallel_for(N, [&](unsigned i)
+    {
+        const unsigned r = i + 1;
+        const unsigned Mmax = std::min(r, N - r + 1);
+        auto &ppi = sums[r];
+        if (ppi.empty())
+            ppi = partition_sums(r, Mmax, weight);
+        else
+            for (unsigned M = ppi.size(); M <= Mmax; ++M)
+                ppi.push_back(block_sum(r, M, weight));
+    });
+}
+}
 
-unsigned CacheFactorials(unsigned N)
+std::vector<ldouble> CacheFactorials(unsigned N)
 {
+    std::lock_guard<std::mutex> lock(log_factorial_mutex);
+
     if (N < log_factorial.size())
         // log factorials have already been cached up to N
-        return log_factorial.size();
+        return std::vector<ldouble>(log_factorial.begin(), log_factorial.begin() + N + 1);
 
     // reserve memory
     log_factorial.reserve(N);
@@ -33,92 +88,383 @@ unsigned CacheFactorials(unsigned N)
     for (unsigned i = log_factorial.size(); i <= N; ++i)
         log_factorial.push_back(log_factorial.back() + log(ldouble(i)));
 
-    return log_factorial.size();
+    return log_factorial;
 }
 
-std::vector<ldouble> CacheChi2(double Tobs, unsigned N)
+std::vector<ldouble> CacheChi2(double Tobs, unsigned N, Executor &executor)
 {
     assert(N>0);
     // to ease addressing, pad with zero element that, if used, should spoil any calculation
     std::vector<ldouble> res(N+1);
     res[0] = std::numeric_limits<ldouble>::quiet_NaN();
 
-    // C style
-#pragma omp parallel for shared(Tobs, N, res)
-    for (size_t i = 1; i <= N; ++i)
-        res[i] = log(ldouble(gsl_cdf_chisq_P(Tobs, i)));
+    executor.parallel_for(N, [&](unsigned i)
+    {
+        res[i + 1] = log(ldouble(gsl_cdf_chisq_P(Tobs, i + 1)));
+    });
     return res;
 }
 
-} // namespace
+std::vector<ldouble> CacheChi2Tail(double Tobs, unsigned N, Executor &executor)
+{
+    assert(N>0);
+    std::vector<ldouble> res(N+1);
+    res[0] = std::numeric_limits<ldouble>::quiet_NaN();
 
-namespace squares
+    executor.parallel_for(N, [&](unsigned i)
+    {
+        res[i + 1] = log1p(-ldouble(gsl_cdf_chisq_Q(Tobs, i + 1)));
+    });
+    return res;
+}
+
+std::vector<ldouble> partition_counts(const unsigned N)
 {
+    // same as the number of partitions of n into parts <= k
+    std::vector<ldouble> res((N + 1) * (N + 1), 0);
+    for (auto k = 0u; k <= N; ++k)
+        res[k] = 1;
+    for (auto n = 1u; n <= N; ++n)
+        for (auto k = 1u; k <= N; ++k)
+            res[n * (N + 1) + k] = res[n * (N + 1) + k - 1] + ((n >= k) ? res[(n - k) * (N + 1) + k] : 0);
+    return res;
+}
 
-double cumulative(const double Tobs, const unsigned N)
+Cut full(const unsigned N)
 {
-    CacheFactorials(N);
+    Cut res(N + 1, 0);
+    for (auto r = 1u; r <= N; ++r)
+        res[r] = std::min(r, N - r + 1);
+    return res;
+}
 
-    // pretabulate chi2 cumulative: given N, we need P(Tobs|i) for i=1...N
-    auto log_cumulative = CacheChi2(Tobs, N);
+/*
+ * Skip partitions with many parts as long as the total neglected mass
+ * stays below `tolerance`.
+ *
+ * With all P(y) <= P(1), the contribution of the (r, M) block is
+ * bounded by
+ *
+ *   U(r, M) = (N-r+1)_M / (2^N - 1) * C(r-1, M-1) / M! * P(1)^M
+ *
+ * because the sum over partitions of 1 / \prod_l c_l! is the number
+ * of compositions of r into M parts divided by M!. Within each r,
+ * only the blocks with the most parts can be skipped as they come
+ * last in the partition order. So we greedily cut the block with the
+ * smallest bound among the current last blocks of every r.
+ */
+Cut prune(const unsigned N,
+          const std::vector<ldouble> &log_cumulative,
+          const std::vector<ldouble> &log_factorial,
+          const ldouble tolerance,
+          ldouble &neglected)
+{
+    auto cut = full(N);
+    neglected = 0;
+    if (!(tolerance > 0))
+        return cut;
+
+    auto log_bound = [&](unsigned r, unsigned M)
+    {
+        return log_block_bound(N, r, M, log_cumulative, log_factorial);
+    };
+
+    using Block = std::pair<ldouble, unsigned>;
+    std::priority_queue<Block, std::vector<Block>, std::greater<Block>> last;
+    for (auto r = 1u; r <= N; ++r)
+        last.emplace(exp(log_bound(r, cut[r])), r);
+
+    while (!last.empty())
+    {
+        const auto b = last.top();
+        if (neglected + b.first > tolerance)
+            break;
+        last.pop();
+        neglected += b.first;
+        const auto r = b.second;
+        if (--cut[r] > 0)
+            last.emplace(exp(log_bound(r, cut[r])), r);
+    }
+
+    return cut;
+}
+
+/*
+ * Checking the subtrees costs about as much as summing their
+ * partitions, so it only pays off if a good part of r can be skipped.
+ * The budgets are split in proportion to the number of partitions,
+ * and any r whose budget is a small fraction of its bound U(r) = \sum_M
+ * U(r, M) is summed without skipping; its budget goes to the others.
+ */
+std::vector<ldouble> skip_budgets(const unsigned N,
+                                  const std::vector<ldouble> &log_cumulative,
+                                  const std::vector<ldouble> &log_factorial,
+                                  const Cut &cut,
+                                  const ldouble tolerance)
+{
+    constexpr ldouble min_fraction = 0.1;
+
+    std::vector<ldouble> budget(N + 1, 0);
+    if (!(tolerance > 0))
+        return budget;
+
+    std::vector<ldouble> bound(N + 1, 0);
+    for (auto r = 1u; r <= N; ++r)
+        for (auto M = 1u; M <= cut[r]; ++M)
+            bound[r] += exp(log_block_bound(N, r, M, log_cumulative, log_factorial));
+
+    const auto count = partition_counts(N);
+    std::vector<bool> skip(N + 1, false);
+    for (auto r = 1u; r <= N; ++r)
+        skip[r] = cut[r] > 0;
+
+    // removing an r only raises the budgets of the others
+    for (bool changed = true; changed;)
+    {
+        ldouble total = 0;
+        for (auto r = 1u; r <= N; ++r)
+            if (skip[r])
+                total += count[r * (N + 1) + cut[r]];
+
+        changed = false;
+        for (auto r = 1u; r <= N; ++r)
+        {
+            budget[r] = skip[r] ? count[r * (N + 1) + cut[r]] * tolerance / total : 0;
+            if (skip[r] && budget[r] < min_fraction * bound[r])
+            {
+                skip[r] = false;
+                budget[r] = 0;
+                changed = true;
+            }
+        }
+    }
+
+    return budget;
+}
+
+std::vector<ldouble> log_scales(const unsigned N, const unsigned r, const unsigned Mmax)
+{
+    // log(2^N-1): bit shift if N small enough, else neglect -1
+    const ldouble logpow2N1 = (N <= 63) ? log((1ul << N) - 1) : N * log(2);
 
     // work on log scale to avoid overflows of Pochhammer symbol,
     // factorial, and the exponential. Use natural log
+    std::vector<ldouble> res(Mmax + 1, 0);
     ldouble poch = 0;
-    // log(2^N-1): bit shift if N small enough, else neglect -1
-    const ldouble logpow2N1 = (N <= 63) ? log((1ul << N) - 1) : N * log(2);
+    for (auto M = 1u; M <= Mmax; ++M)
+    {
+        // compute Pochhammer iteratively
+        // (...)_{M+1}/ (...)_M = N-r+1-M but to start the iteration we have to add 1
+        poch += log(ldouble(N - r + 2 - M));
+
+        // this factor is independent of the actual partition,
+        // only depends on M,r,N
+        res[M] = poch - logpow2N1;
+    }
+    return res;
+}
+
+void exact_sums(const double Tobs, const unsigned N, const Cut &cut, Sums &sums,
+                const std::function<void(unsigned)> &done, const Precision precision,
+                Executor &executor)
+{
+    const auto log_factorial = CacheFactorials(N);
+    const auto log_cumulative = CacheChi2(Tobs, N, executor);
+    const std::vector<ldouble> budget(N + 1, 0);
+
+    // double has a much smaller range, so fall back to long double if needed
+    if (precision != Precision::extended && LinearWeight<double>::representable(log_cumulative, log_factorial))
+    {
+        const LinearWeight<double> weight(log_cumulative, log_factorial);
+        if (precision == Precision::fast)
+            block_sums(N, weight, cut, nullptr, budget, sums, done, executor);
+        else
+            block_sums<LinearWeight<double>, CompensatedSum>(N, weight, cut, nullptr, budget, sums, done, executor);
+    }
+    else if (LinearWeight<ldouble>::representable(log_cumulative, log_factorial))
+        block_sums(N, LinearWeight<ldouble>(log_cumulative, log_factorial), cut, nullptr, budget, sums, done, executor);
+    else
+        block_sums(N, LogWeight{log_cumulative, log_factorial}, cut, nullptr, budget, sums, done, executor);
+}
+
+void extend_sums(const double Tobs, const unsigned N, Sums &sums, Executor &executor)
+{
+    const auto log_factorial = CacheFactorials(N);
+    const auto log_cumulative = CacheChi2(Tobs, N, executor);
+
+    if (LinearWeight<ldouble>::representable(log_cumulative, log_factorial))
+        extend_blocks(N, LinearWeight<ldouble>(log_cumulative, log_factorial), sums, executor);
+    else
+        extend_blocks(N, LogWeight{log_cumulative, log_factorial}, sums, executor);
+}
+
+ldouble pairwise_sum(const ldouble *first, const ldouble *last)
+{
+    // short ranges are summed directly, it only matters that the split is fixed
+    if (last - first <= 8)
+    {
+        ldouble res = 0;
+        for (; first != last; ++first)
+            res += *first;
+        return res;
+    }
+    const auto middle = first + (last - first) / 2;
+    return pairwise_sum(first, middle) + pairwise_sum(middle, last);
+}
+
+ldouble combine(const unsigned N, const Sums &sums)
+{
+    // all terms in a fixed order
+    std::vector<ldouble> terms;
+    for (auto r = 1u; r <= N; ++r)
+    {
+        const auto &ppi = sums[r];
+        if (ppi.empty())
+            continue;
+        const unsigned Mmax = std::min<unsigned>(ppi.size() - 1, N - r + 1);
+        const auto log_scale = log_scales(N, r, Mmax);
+
+        // have to stay on linear scale
+        for (auto M = 1u; M <= Mmax; ++M)
+            terms.push_back(exp(log_scale[M] + log(ppi[M])));
+    }
 
     // the p value
-    ldouble p = 0;
+    const ldouble p = pairwise_sum(terms.data(), terms.data() + terms.size());
+    assert(p < 1);
 
+    return p;
+}
+
+ldouble log_combine(const unsigned N, const Sums &sums)
+{
+    std::vector<ldouble> terms;
+    for (auto r = 1u; r <= N; ++r)
+    {
+        const auto &ppi = sums[r];
+        if (ppi.empty())
+            continue;
+        const unsigned Mmax = std::min<unsigned>(ppi.size() - 1, N - r + 1);
+        const auto log_scale = log_scales(N, r, Mmax);
+        for (auto M = 1u; M <= Mmax; ++M)
+            terms.push_back(log_scale[M] + log(ppi[M]));
+    }
+
+    // log-sum-exp relative to the largest term
+    const ldouble largest = *std::max_element(terms.begin(), terms.end());
+    if (!std::isfinite(largest))
+        return largest;
+    for (auto &t : terms)
+        t = exp(t - largest);
+    return largest + log(pairwise_sum(terms.data(), terms.data() + terms.size()));
+}
+
+} // namespace detail
+
+using namespace detail;
+
+namespace
+{
+
+class Serial : public Executor
+{
+ public:
+  void parallel_for(unsigned n, const std::function<void(unsigned)> &task) override
+  {
+      for (auto i = 0u; i < n; ++i)
+          task(i);
+  }
+};
+
+class OpenMP : public Executor
+{
+ public:
+  void parallel_for(unsigned n, const std::function<void(unsigned)> &task) override
+  {
 // in tests for N=10 dynamic was better than schedule(static,2). Since
 // part(r, M) is really different, each iteration can vary in time
 // very much. Hyperthreading seemed to help a lot on my Intel K4770.
-#pragma omp parallel for schedule(dynamic) private(poch) shared(log_cumulative, log_factorial) reduction(+:p)
-    for (auto r = 1ul; r <= N; ++r)
-    {
-        // const unsigned long Mmax = (r <= N-r+1)? r : N-r+1;
-        const auto Mmax = std::min(r, N - r + 1);
-        poch = 0;
-        for (auto M = 1ul; M <= Mmax; ++M)
-        {
-            // compute Pochhammer iteratively
-            // (...)_{M+1}/ (...)_M = N-r+1-M but to start the iteration we have to add 1
-            poch += log(ldouble(N - r + 2 - M));
+#pragma omp parallel for schedule(dynamic) shared(task)
+      for (auto i = 0u; i < n; ++i)
+          task(i);
+  }
+};
 
-            // this factor is independent of the actual partition,
-            // only depends on M,r,N
-            const ldouble scale = poch - logpow2N1;
+} // namespace
 
-            // maintain sum over partitions
-            ldouble ppi = 0;
+Executor &serial()
+{
+    static Serial executor;
+    return executor;
+}
 
-            // visit all partitions, save ref to partition
-            partitions::KPartitionGenerator g(r, M);
-            auto &n = g->mult();
-            auto &y = g->parts();
+Executor &openmp()
+{
+    static OpenMP executor;
+    return executor;
+}
 
-            for (; g; ++g)
-            {
-                const auto h = g->distinct_parts();
+double cumulative(const double Tobs, const unsigned N)
+{
+    return cumulative(Tobs, N, 0, nullptr);
+}
 
-                // perform sum on log scale within a partition
-                ldouble ppartition = 0;
+double cumulative(const double Tobs, const unsigned N, const double tolerance, double *bound, Executor &executor)
+{
+    const auto log_factorial = CacheFactorials(N);
 
-                for (size_t l = 1; l <= h; ++l)
-                {
-                    ppartition += n[l] * log_cumulative[y[l]] - ::log_factorial[n[l]];
-                }
-                ppi += exp(ppartition);
-            }
+    // pretabulate chi2 cumulative: given N, we need P(Tobs|i) for i=1...N
+    auto log_cumulative = CacheChi2(Tobs, N, executor);
 
-            // have to stay on linear scale
-            p += exp(scale + log(ppi));
-        }
-    }
-    assert(p < 1);
+    // Spend half of the tolerance on skipping entire (r, M) blocks. The
+    // rest goes to skipping subtrees within the r where that pays off,
+    // or else to skipping more blocks.
+    ldouble neglected;
+    auto cut = prune(N, log_cumulative, log_factorial, tolerance / 2, neglected);
+    const auto budget = skip_budgets(N, log_cumulative, log_factorial, cut, tolerance - neglected);
+    std::unique_ptr<SubtreeBound> completions;
+    if (std::any_of(budget.begin(), budget.end(), [](const ldouble b) { return b > 0; }))
+        completions.reset(new SubtreeBound(log_cumulative, log_factorial));
+    else
+        cut = prune(N, log_cumulative, log_factorial, tolerance, neglected);
 
-    return p;
+    Sums sums;
+    if (LinearWeight<ldouble>::representable(log_cumulative, log_factorial))
+        neglected += block_sums(N, LinearWeight<ldouble>(log_cumulative, log_factorial), cut, completions.get(), budget,
+                                sums, nullptr, executor);
+    else
+        neglected += block_sums(N, LogWeight{log_cumulative, log_factorial}, cut, completions.get(), budget, sums,
+                                nullptr, executor);
+
+    if (bound)
+        *bound = neglected;
+
+    return combine(N, sums);
+}
+
+double cumulative(const double Tobs, const unsigned N, Executor &executor)
+{
+    Sums sums;
+    exact_sums(Tobs, N, full(N), sums, nullptr, Precision::extended, executor);
+    return combine(N, sums);
+}
+
+double cumulative(const double Tobs, const unsigned N, const Precision precision, Executor &executor)
+{
+    Sums sums;
+    exact_sums(Tobs, N, full(N), sums, nullptr, precision, executor);
+    return combine(N, sums);
+}
+
+std::vector<double> cumulatives(const double Tobs, const unsigned N, Executor &executor)
+{
+    Sums sums;
+    exact_sums(Tobs, N, full(N), sums, nullptr, Precision::extended, executor);
+
+    std::vector<double> res(N + 1, std::numeric_limits<double>::quiet_NaN());
+    for (auto n = 1u; n <= N; ++n)
+        res[n] = combine(n, sums);
+    return res;
 }
 
 double pvalue(const double Tobs, const unsigned N)
@@ -126,4 +472,21 @@ double pvalue(const double Tobs, const unsigned N)
     return 1 - cumulative(Tobs, N);
 }
 
+double pvalue(const double Tobs, const unsigned N, Executor &executor)
+{
+    return 1 - cumulative(Tobs, N, executor);
+}
+
+double log_pvalue(const double Tobs, const unsigned N, Executor &executor)
+{
+    const auto log_factorial = CacheFactorials(N);
+    const auto log_cumulative = CacheChi2Tail(Tobs, N, executor);
+    const std::vector<ldouble> budget(N + 1, 0);
+
+    Sums sums;
+    block_sums<TailWeight, ldouble>(N, TailWeight(log_cumulative, log_factorial), full(N), nullptr, budget, sums,
+                                    nullptr, executor);
+    return log_combine(N, sums);
+}
+
 } // namespace squares
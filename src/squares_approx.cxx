@@ -1,25 +1,96 @@
 #include "squares_approx.h"
 #include "squares.h"
 
-#include "cubature.h"
-
 #include <gsl/gsl_cdf.h>
-#include <gsl/gsl_integration.h>
 #include <gsl/gsl_interp.h>
 #include <gsl/gsl_math.h>
 #include <gsl/gsl_randist.h>
+#include <gsl/gsl_sf_gamma.h>
 #include <gsl/gsl_spline.h>
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <cmath>
+#include <map>
 #include <stdexcept>
 
 namespace {
-    struct IntegrandData
+    /* weight of the i-th term in h and H */
+    inline double term_weight(const unsigned i, const unsigned N)
     {
-        double Tobs;
-        unsigned Nl, Nr;
-    };
+        return std::ldexp(1.0, -int(std::min(i + 1, N)));
+    }
+
+    /*
+     * Delta(T, Nl, Nr) in closed form. The sum of independent chi2
+     * variables with i and j degrees of freedom is chi2 with i + j, so
+     * the convolution
+     *
+     *   \int_0^T p(x, i) P(T - x, j) dx = P(T, i + j)
+     *
+     * and with P(a, b, j) = P(b, j) - P(a, j) in H
+     *
+     *   Delta = \sum_ij w_i w_j [P(T, i) P(T, j) - P(T, i + j)].
+     *
+     * Every term is the probability that both variables are below T
+     * but their sum is not. To avoid cancellation, it is computed from
+     * the P or from the Q = 1 - P, whichever are small. Both follow for
+     * all degrees of freedom from a few special functions with
+     *
+     *   P(T, k) = P(T, k + 2) + 2 p(T, k + 2),
+     *   Q(T, k + 2) = Q(T, k) + 2 p(T, k + 2),
+     *
+     * which add positive terms only.
+     */
+    double Delta_closed(const double T, const unsigned Nl, const unsigned Nr)
+    {
+        if (!(T > 0) || Nl == 0 || Nr == 0)
+            return 0;
+
+        const unsigned K = Nl + Nr;
+        // index k for k degrees of freedom, 0 unused
+        std::vector<double> p(K + 1), P(K + 1), Q(K + 1);
+
+        // densities in logs to survive a large T
+        double lp[2] = {-0.5 * T - 0.5 * std::log(2 * M_PI * T), -0.5 * T - M_LN2};
+        for (auto k = 1u; k <= K; ++k)
+        {
+            auto &l = lp[(k + 1) % 2];
+            if (k > 2)
+                l += std::log(T / (k - 2));
+            p[k] = std::exp(l);
+        }
+
+        Q[1] = std::erfc(std::sqrt(0.5 * T));
+        Q[2] = std::exp(-0.5 * T);
+        for (auto k = 3u; k <= K; ++k)
+            Q[k] = Q[k - 2] + 2 * p[k];
+
+        P[K] = gsl_cdf_chisq_P(T, K);
+        P[K - 1] = gsl_cdf_chisq_P(T, K - 1);
+        for (auto k = K - 2; k >= 1; --k)
+            P[k] = P[k + 2] + 2 * p[k + 2];
+
+        std::vector<double> wr(Nr + 1);
+        for (auto j = 1u; j <= Nr; ++j)
+            wr[j] = term_weight(j, Nr);
+
+        double res = 0;
+        for (auto i = 1u; i <= Nl; ++i)
+        {
+            double row = 0;
+            for (auto j = 1u; j <= Nr; ++j)
+            {
+                const auto s = i + j;
+                const double term = (P[s] < 0.5) ? P[i] * P[j] - P[s]
+                                                 : Q[s] - Q[i] - Q[j] + Q[i] * Q[j];
+                row += wr[j] * term;
+            }
+            res += term_weight(i, Nl) * row;
+        }
+        return res;
+    }
 
     struct CubaIntegrandData
     {
@@ -28,7 +99,284 @@ namespace {
         unsigned counter;
         gsl_spline* spline;
         gsl_interp_accel* acc;
+        /* F(Tobs | Nl + Nr) if not interpolated */
+        double F;
+        squares::CumulativeInterpolant *interpolant;
+    };
+
+    /*
+     * Grundmann-Moeller rules of degree 7 and 5 on the triangle with
+     * vertices (0, 0), (1, 0), (0, 1), nodes in barycentric
+     * coordinates. Every node of the degree-5 rule is a node of the
+     * degree-7 rule, so both need only the 19 nodes of the latter.
+     */
+    struct TriangleNode
+    {
+        double b[3];
+        double w7, w5;
+    };
+
+    const std::vector<TriangleNode> &grundmann_moeller()
+    {
+        static const std::vector<TriangleNode> nodes = []()
+        {
+            std::vector<TriangleNode> res;
+            for (int s = 3; s >= 2; --s)
+            {
+                const int d = 2 * s + 1;
+                for (int i = 0; i <= s; ++i)
+                {
+                    // n = 2 dimensions
+                    const int den = d + 2 - 2 * i;
+                    const double w = ((i % 2) ? -1 : 1) * std::ldexp(std::pow(den, d), -2 * s)
+                                     / (gsl_sf_fact(i) * gsl_sf_fact(d + 2 - i));
+                    const int m = s - i;
+                    for (int b0 = m; b0 >= 0; --b0)
+                    {
+                        for (int b1 = m - b0; b1 >= 0; --b1)
+                        {
+                            const double b[3] = {(2.0 * b0 + 1) / den, (2.0 * b1 + 1) / den,
+                                                 (2.0 * (m - b0 - b1) + 1) / den};
+                            auto node = std::find_if(res.begin(), res.end(), [&](const TriangleNode &n)
+                            {
+                                return std::abs(n.b[0] - b[0]) < 1e-14 && std::abs(n.b[1] - b[1]) < 1e-14;
+                            });
+                            if (node == res.end())
+                                node = res.insert(res.end(), TriangleNode{{b[0], b[1], b[2]}, 0, 0});
+                            (s == 3 ? node->w7 : node->w5) += w;
+                        }
+                    }
+                }
+            }
+            return res;
+        }();
+        return nodes;
+    }
+
+    /* vertices x0, y0, x1, y1, x2, y2 in units of Tobs and the estimates */
+    struct Triangle
+    {
+        double v[6];
+        double value, error;
     };
+
+    inline double area(const double *v)
+    {
+        return 0.5 * std::abs((v[2] - v[0]) * (v[5] - v[1]) - (v[4] - v[0]) * (v[3] - v[1]));
+    }
+
+    /*
+     * h(x) ~ 1 / sqrt(x), so the integrand is singular at the vertices
+     * (Tobs, 0) and (0, Tobs) of the domain. On a triangle with such a
+     * vertex, move the nodes towards it: with rho = 1 - b_k the
+     * distance from vertex k in barycentric coordinates, map rho to
+     * rho^2 at fixed direction. The Jacobian 2 rho^2 cancels the
+     * singularity, and the rules see a smooth integrand.
+     */
+    void integrate(Triangle &t, CubaIntegrandData &d)
+    {
+        int singular = -1;
+        for (auto k = 0u; k < 3; ++k)
+        {
+            if (t.v[2 * k] == 0 || t.v[2 * k + 1] == 0)
+                singular = k;
+        }
+
+        double q7 = 0, q5 = 0;
+        for (const auto &n : grundmann_moeller())
+        {
+            double b[3] = {n.b[0], n.b[1], n.b[2]};
+            double jac = 1;
+            if (singular >= 0)
+            {
+                const double rho = 1 - b[singular];
+                for (auto k = 0u; k < 3; ++k)
+                    b[k] *= rho;
+                b[singular] = 1 - rho * rho;
+                jac = 2 * rho * rho;
+            }
+            const double x = d.Tobs * (b[0] * t.v[0] + b[1] * t.v[2] + b[2] * t.v[4]);
+            const double y = d.Tobs * (b[0] * t.v[1] + b[1] * t.v[3] + b[2] * t.v[5]);
+            const double F = d.interpolant ? (*d.interpolant)(x + y)
+                             : (d.spline && d.acc) ? gsl_spline_eval(d.spline, x + y, d.acc) : d.F;
+            const double f = jac * squares::h(x, d.Nl) * squares::h(y, d.Nr) * F;
+            q7 += n.w7 * f;
+            q5 += n.w5 * f;
+            ++d.counter;
+        }
+        // the rules integrate over an area 1/2
+        const double scale = 2 * area(t.v) * d.Tobs * d.Tobs;
+        t.value = scale * q7;
+        t.error = scale * std::abs(q7 - q5);
+    }
+
+    /* halve the longest edge */
+    void bisect(const Triangle &t, Triangle &a, Triangle &b)
+    {
+        unsigned longest = 0;
+        double lmax = 0;
+        for (auto k = 0u; k < 3; ++k)
+        {
+            const double *p = t.v + 2 * k, *q = t.v + 2 * ((k + 1) % 3);
+            const double l = std::pow(q[0] - p[0], 2) + std::pow(q[1] - p[1], 2);
+            if (l > lmax)
+            {
+                lmax = l;
+                longest = k;
+            }
+        }
+        const double *p = t.v + 2 * longest, *q = t.v + 2 * ((longest + 1) % 3),
+                     *r = t.v + 2 * ((longest + 2) % 3);
+        const double m[2] = {0.5 * (p[0] + q[0]), 0.5 * (p[1] + q[1])};
+        a = Triangle{{p[0], p[1], m[0], m[1], r[0], r[1]}, 0, 0};
+        b = Triangle{{m[0], m[1], q[0], q[1], r[0], r[1]}, 0, 0};
+    }
+
+    /*
+     * Merge the two halves of a bisection back into their parent if
+     * their combined error is below `threshold`, one level at a time,
+     * so a warm start over a long scan does not keep every triangle it
+     * ever needed.
+     */
+    std::vector<Triangle> coarsen(const std::vector<Triangle> &triangles, const double threshold)
+    {
+        // `bisect` makes (p, m, r) and (m, q, r) with m the midpoint of p and q
+        using Key = std::array<double, 4>;
+        std::map<Key, unsigned> second;
+        for (auto i = 0u; i < triangles.size(); ++i)
+        {
+            const auto &v = triangles[i].v;
+            second.emplace(Key{{v[0], v[1], v[4], v[5]}}, i);
+        }
+
+        std::vector<bool> merged(triangles.size(), false);
+        std::vector<Triangle> res;
+        for (auto i = 0u; i < triangles.size(); ++i)
+        {
+            if (merged[i])
+                continue;
+            const auto &a = triangles[i];
+            const auto j = second.find(Key{{a.v[2], a.v[3], a.v[4], a.v[5]}});
+            if (j != second.end() && j->second != i && !merged[j->second])
+            {
+                const auto &b = triangles[j->second];
+                if (a.error + b.error < threshold && a.v[2] == 0.5 * (a.v[0] + b.v[2])
+                    && a.v[3] == 0.5 * (a.v[1] + b.v[3]))
+                {
+                    merged[i] = merged[j->second] = true;
+                    res.push_back(Triangle{{a.v[0], a.v[1], b.v[2], b.v[3], a.v[4], a.v[5]}, 0, 0});
+                }
+            }
+        }
+        for (auto i = 0u; i < triangles.size(); ++i)
+        {
+            if (!merged[i])
+                res.push_back(triangles[i]);
+        }
+        return res;
+    }
+
+    /*
+     * Integrate over the triangle with vertices (Tobs, Tobs), (Tobs, 0),
+     * (0, Tobs) directly, subdivided by bisection. The integrand is
+     * symmetric under x <-> y if Nl == Nr, then only the half below
+     * the diagonal is needed.
+     *
+     * An F interpolated linearly has kinks along x + y = const at the
+     * grid points. Start from `nstrips` strips between them, cut into
+     * triangles, so no triangle straddles a kink or the diagonal.
+     */
+    double integrate_triangle(CubaIntegrandData &data, const unsigned nstrips, const double epsrel,
+                              const double epsabs, squares::Subdivision *warm)
+    {
+        const bool symmetric = data.Nl == data.Nr;
+        const double factor = symmetric ? 2 : 1;
+        constexpr size_t maxEval = 10000;
+        const size_t npoints = grundmann_moeller().size();
+        std::vector<Triangle> heap;
+        // re-evaluating the warm start counts towards maxEval, leave room for refinement
+        if (warm && !warm->regions.empty() && warm->regions.size() / 6 * npoints <= maxEval / 2)
+        {
+            for (auto i = 0u; i + 6 <= warm->regions.size(); i += 6)
+            {
+                heap.push_back(Triangle{{}, 0, 0});
+                std::copy(&warm->regions[i], &warm->regions[i] + 6, heap.back().v);
+            }
+            // only if it covers the same domain
+            double covered = 0;
+            for (const auto &t : heap)
+                covered += area(t.v);
+            if (std::abs(covered - 0.5 / factor) > 1e-12)
+                heap.clear();
+        }
+        if (heap.empty())
+        {
+            for (auto k = 0u; k < nstrips; ++k)
+            {
+                // strip between x + y = 1 + a and 1 + b in units of Tobs, below the diagonal
+                const double a = double(k) / nstrips;
+                const double b = double(k + 1) / nstrips;
+                const double ma = 0.5 * (1 + a), mb = 0.5 * (1 + b);
+                heap.push_back(Triangle{{1, a, 1, b, ma, ma}, 0, 0});
+                if (k + 1 < nstrips)
+                    heap.push_back(Triangle{{1, b, mb, mb, ma, ma}, 0, 0});
+            }
+            // mirror above the diagonal
+            if (!symmetric)
+            {
+                const auto n = heap.size();
+                for (auto i = 0u; i < n; ++i)
+                {
+                    const auto &v = heap[i].v;
+                    heap.push_back(Triangle{{v[1], v[0], v[3], v[2], v[5], v[4]}, 0, 0});
+                }
+            }
+        }
+
+        double res = 0, err = 0;
+        for (auto &t : heap)
+        {
+            integrate(t, data);
+            res += t.value;
+            err += t.error;
+        }
+
+        auto less_error = [](const Triangle &a, const Triangle &b) { return a.error < b.error; };
+        std::make_heap(heap.begin(), heap.end(), less_error);
+        while (factor * err > std::max(epsabs, epsrel * factor * std::abs(res)) && data.counter < maxEval)
+        {
+            std::pop_heap(heap.begin(), heap.end(), less_error);
+            const Triangle worst = heap.back();
+            heap.pop_back();
+            Triangle a, b;
+            bisect(worst, a, b);
+            integrate(a, data);
+            integrate(b, data);
+            res += a.value + b.value - worst.value;
+            err += a.error + b.error - worst.error;
+            for (const auto &t : {a, b})
+            {
+                heap.push_back(t);
+                std::push_heap(heap.begin(), heap.end(), less_error);
+            }
+        }
+
+        // sum again without the updates' round-off
+        res = 0;
+        for (const auto &t : heap)
+            res += t.value;
+        res *= factor;
+
+        if (warm)
+        {
+            const double target = std::max(epsabs, epsrel * std::abs(res)) / factor;
+            warm->regions.clear();
+            for (const auto &t : coarsen(heap, 0.01 * target / heap.size()))
+                warm->regions.insert(warm->regions.end(), t.v, t.v + 6);
+            warm->evaluations = data.counter;
+        }
+        return res;
+    }
 }
 
 namespace squares
@@ -62,53 +410,24 @@ double H(const double a, const double b, const unsigned N)
     return res;
 }
 
-double gsl_integrand(double x, void *params)
+double Delta(const double Tobs, const unsigned Nl, const unsigned Nr, double, double)
 {
-    const IntegrandData &d = *static_cast<IntegrandData *>(params);
-
-    return h(x, d.Nl) * H(d.Tobs - x, d.Tobs, d.Nr);
-}
-
-double Delta(const double Tobs, const unsigned Nl, const unsigned Nr, double epsrel, double epsabs)
-{
-    // gsl numerical integration
-    constexpr size_t limit = 1000;
-    gsl_integration_workspace *w = gsl_integration_workspace_alloc(limit);
-
-    double result, error;
-
-    gsl_function F;
-    F.function = &gsl_integrand;
-    ::IntegrandData data{Tobs, Nl, Nr};
-    F.params = &data;
-
-    gsl_integration_qag(&F, 0, Tobs, epsabs, epsrel, limit, GSL_INTEG_GAUSS21, w, &result, &error);
-
-    // printf ("result          = % .17e\n", result);
-    // printf ("estimated error = % .6e\n", error);
-    // printf ("intervals       = %zu\n", w->size);
-
-    gsl_integration_workspace_free(w);
-
-    return result;
+    return Delta_closed(Tobs, Nl, Nr);
 }
 
-int cubature_integrand(unsigned /*ndim*/, const double *uv, void *data, unsigned /*fdim*/, double *fval)
+std::vector<double> Delta(const std::vector<double> &Tobs,
+                          const unsigned Nl,
+                          const unsigned Nr,
+                          double,
+                          double,
+                          Executor &executor)
 {
-    CubaIntegrandData &d = *static_cast<CubaIntegrandData *>(data);
-    ++d.counter;
-
-    /*  transform from unit square to triangle with vertices (Tobs, Tobs), (Tobs, 0), (0, Tobs)  */
-    const auto u = uv[0];
-    const auto v = uv[1];
-    const auto x = d.Tobs * u * (1 - v) + d.Tobs * (1 - u);
-    const auto y = d.Tobs * u * v + d.Tobs * (1 - u);
-    const auto jac = d.Tobs * d.Tobs * u;
-
-    *fval = jac * h(x, d.Nl) * h(y, d.Nr);
-    *fval *= (d.spline && d.acc) ? gsl_spline_eval(d.spline, x + y, d.acc) : cumulative(d.Tobs, d.Nl + d.Nr);
-
-    return 0;
+    std::vector<double> res(Tobs.size());
+    executor.parallel_for(Tobs.size(), [&](unsigned t)
+    {
+        res[t] = Delta_closed(Tobs[t], Nl, Nr);
+    });
+    return res;
 }
 
 double full_correction(const double Tobs,
@@ -116,9 +435,10 @@ double full_correction(const double Tobs,
                        const unsigned Nr,
                        double epsrel,
                        double epsabs,
-                       unsigned ninterp)
+                       unsigned ninterp,
+                       Subdivision *warm)
 {
-    ::CubaIntegrandData data{Tobs, Nl, Nr, 0, nullptr, nullptr};
+    ::CubaIntegrandData data{Tobs, Nl, Nr, 0, nullptr, nullptr, 0, nullptr};
 
     /* evaluate F on a grid (Tobs, ..., 2*Tobs) for interpolation */
     gsl_interp_accel *acc = nullptr;
@@ -146,20 +466,10 @@ double full_correction(const double Tobs,
     data.acc = acc;
     data.spline = spline;
 
-    constexpr unsigned fdim = 1;
-    constexpr unsigned dim = 2;
-    constexpr double uvmin[dim] = {0.0, 0.0};
-    constexpr double uvmax[dim] = {1.0, 1.0};
-    constexpr size_t maxEval = 10000;
-    double res;
-    double err;
+    if (!spline)
+        data.F = cumulative(Tobs, Nl + Nr);
 
-    if (hcubature(fdim, cubature_integrand, &data, dim, uvmin, uvmax,
-                  maxEval, epsabs, epsrel, ERROR_L2, &res, &err))
-    {
-        throw std::runtime_error("hcubature failed");
-    }
-    // printf("Computed integral = %0.10g +/- %g with %d calls\n", res, err, data.counter);
+    const double res = integrate_triangle(data, spline ? ninterp - 1 : 1, epsrel, epsabs, warm);
 
     gsl_spline_free(spline);
     gsl_interp_accel_free(acc);
@@ -169,16 +479,81 @@ double full_correction(const double Tobs,
     return res;
 }
 
-double approx_cumulative(const double Tobs, const unsigned N, const double n, double epsrel, double epsabs)
+double full_correction(const double Tobs,
+                       const unsigned Nl,
+                       const unsigned Nr,
+                       CumulativeInterpolant &F,
+                       double epsrel,
+                       double epsabs,
+                       Subdivision *warm)
+{
+    if (F.N() != Nl + Nr)
+        throw std::invalid_argument("Need an interpolant for Nl + Nr");
+
+    ::CubaIntegrandData data{Tobs, Nl, Nr, 0, nullptr, nullptr, 0, &F};
+    return integrate_triangle(data, 1, epsrel, epsabs, warm);
+}
+
+double approx_cumulative(const double Tobs, const unsigned N, const double n, double epsrel, double epsabs,
+                         Executor &executor)
 {
-    const auto F = cumulative(Tobs, N);
+    const auto F = cumulative(Tobs, N, executor);
     const auto Fn1 = pow(F / (1 + Delta(Tobs, N, N, epsrel, epsabs)), n - 1);
     return F * Fn1;
 }
 
-double approx_pvalue(const double Tobs, const unsigned N, const double n, double epsrel, double epsabs)
+double approx_pvalue(const double Tobs, const unsigned N, const double n, double epsrel, double epsabs,
+                     Executor &executor)
+{
+    return 1 - approx_cumulative(Tobs, N, n, epsrel, epsabs, executor);
+}
+
+double approx_cumulative(const double Tobs, const std::vector<unsigned> &chunks, double epsrel, double epsabs,
+                         Executor &executor)
+{
+    if (chunks.empty())
+        throw std::invalid_argument("Need at least one chunk");
+
+    std::map<unsigned, double> F;
+    std::map<std::pair<unsigned, unsigned>, double> D;
+    for (auto N : chunks)
+        if (!F.count(N))
+            F[N] = cumulative(Tobs, N, executor);
+
+    double res = F[chunks.front()];
+    unsigned Nl = chunks.front();
+    for (auto i = 1u; i < chunks.size(); ++i)
+    {
+        // The weight of the i-th term in h(x, Nl) is 2^-i, so beyond
+        // 64 the left chunk is as good as infinitely long and Delta
+        // can be reused.
+        const auto key = std::make_pair(std::min(Nl, 64u), chunks[i]);
+        if (!D.count(key))
+            D[key] = Delta(Tobs, key.first, key.second, epsrel, epsabs);
+
+        res *= F[chunks[i]] / (1 + D[key]);
+        Nl += chunks[i];
+    }
+
+    return res;
+}
+
+double approx_pvalue(const double Tobs, const std::vector<unsigned> &chunks, double epsrel, double epsabs,
+                     Executor &executor)
 {
-    return 1 - approx_cumulative(Tobs, N, n, epsrel, epsabs);
+    return 1 - approx_cumulative(Tobs, chunks, epsrel, epsabs, executor);
+}
+
+std::vector<unsigned> chunks(const unsigned Ntotal, const unsigned Nmax)
+{
+    if (Ntotal == 0 || Nmax == 0)
+        throw std::invalid_argument("Need Ntotal > 0 and Nmax > 0");
+
+    const unsigned k = (Ntotal + Nmax - 1) / Nmax;
+    std::vector<unsigned> res(k, Ntotal / k);
+    for (auto i = 0u; i < Ntotal % k; ++i)
+        ++res[i];
+    return res;
 }
 
 }
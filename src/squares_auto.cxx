@@ -0,0 +1,137 @@
+// Copyright 2018 Frederik Beaujean <beaujean@mpp.mpg.de>
+
+#include "squares_approx.h"
+#include "squares.h"
+#include "squares_detail.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace
+{
+
+// beyond, the exact cumulative would take years
+constexpr unsigned max_exact_N = 300;
+
+unsigned threads()
+{
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+/*
+ * The work is parallelized over r, so the wall time is proportional to
+ * the number of partitions per thread unless a single r takes longer.
+ */
+double work(const unsigned N)
+{
+    const auto count = squares::detail::partition_counts(N);
+    const auto cut = squares::detail::full(N);
+    double total = 0;
+    double largest = 0;
+    for (auto r = 1u; r <= N; ++r)
+    {
+        const double c = count[r * (N + 1) + cut[r]];
+        total += c;
+        largest = std::max(largest, c);
+    }
+    return std::max(total / threads(), largest);
+}
+
+/// Wall time per unit of `work`, measured once
+double seconds_per_work()
+{
+    static const double t = []
+    {
+        constexpr unsigned N = 50;
+        const auto start = std::chrono::steady_clock::now();
+        squares::cumulative(1, N);
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / work(N);
+    }();
+    return t;
+}
+
+double exact_time(const unsigned N)
+{
+    if (N > max_exact_N)
+        return std::numeric_limits<double>::infinity();
+    return work(N) * seconds_per_work();
+}
+
+} // namespace
+
+namespace squares
+{
+
+double pvalue_auto(const double Tobs,
+                   const unsigned Ntotal,
+                   const double tolerance,
+                   const double time_budget,
+                   AutoChoice *choice)
+{
+    AutoChoice c{Ntotal, 1, 0, 0, exact_time(Ntotal), true};
+
+    // too short to split
+    if (c.time <= time_budget || Ntotal < 4)
+    {
+        if (choice)
+            *choice = c;
+        return pvalue(Tobs, Ntotal);
+    }
+
+    // Increase the chunk length until the error estimate meets the
+    // tolerance. Each step needs the exact F(T | N) and F(2T | N). For
+    // chunks shorter than about Tobs, the approximation doesn't
+    // converge monotonically yet, so start beyond.
+    double F = 0;
+    double spent = 0;
+    unsigned previous = 0;
+    const unsigned first = std::min(Ntotal / 2, std::max(15u, unsigned(std::ceil(Tobs))));
+    for (unsigned N = first; N <= Ntotal / 2; N = std::max(N + 1, unsigned(1.5 * N)))
+    {
+        const double t = 2 * exact_time(N);
+        if (spent > 0 && spent + t > time_budget)
+            break;
+        spent += t;
+
+        const double F1 = cumulative(Tobs, N);
+        const double F2 = cumulative(2 * Tobs, N);
+        const double D = Delta(Tobs, N, N);
+        const double n = double(Ntotal) / N;
+
+        // F(T | 2N) lies in [F1^2 - F2 D, F1^2 / (1 + D)], the approximation is at the upper end
+        const double F12 = F1 * F1 / (1 + D);
+        const double rel = D * (F2 - F12) / F12;
+
+        const double Fprevious = F;
+        F = F1 * std::pow(F1 / (1 + D), n - 1);
+        c = AutoChoice{N, n, std::min(F, (n - 1) * rel * F), 0, spent, false};
+
+        // The bound is loose for long chunks. The error decreases about
+        // like 1/N, so extrapolate from the change of the result. This
+        // is only a heuristic and doesn't decide convergence
+        if (previous)
+            c.extrapolated = std::abs(F - Fprevious) * previous / (N - previous);
+        previous = N;
+
+        c.converged = c.error <= tolerance;
+        if (c.converged)
+            break;
+    }
+
+    if (choice)
+        *choice = c;
+    return 1 - F;
+}
+
+}
@@ -0,0 +1,207 @@
+// Copyright 2018 Frederik Beaujean <beaujean@mpp.mpg.de>
+
+#include "squares.h"
+#include "squares_detail.h"
+
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <future>
+#include <sstream>
+#include <stdexcept>
+
+using squares::detail::ldouble;
+
+namespace
+{
+
+/*
+ * The checkpoint is a text file. The header identifies the computation
+ * and the floating-point format, then there is one line per completed r
+ *
+ * squares checkpoint
+ * <Tobs in %a> <N> <sizeof(long double)> <LDBL_MANT_DIG>
+ * <r> <Mmax> <bytes of sum for M = 1> ... <bytes of sum for M = Mmax>
+ *
+ * Each sum is written as the hex dump of its bytes to restore it
+ * without any rounding.
+ */
+
+const std::string magic = "squares checkpoint";
+
+std::string header(const double Tobs, const unsigned N)
+{
+    char buf[128];
+    std::snprintf(buf, sizeof(buf), "%a %u %u %d", Tobs, N, unsigned(sizeof(ldouble)), LDBL_MANT_DIG);
+    return buf;
+}
+
+std::string to_hex(const ldouble x)
+{
+    unsigned char bytes[sizeof(ldouble)];
+    std::memcpy(bytes, &x, sizeof(ldouble));
+    std::string res;
+    char buf[3];
+    for (auto b : bytes)
+    {
+        std::snprintf(buf, sizeof(buf), "%02x", b);
+        res += buf;
+    }
+    return res;
+}
+
+ldouble from_hex(const std::string &s)
+{
+    if (s.size() != 2 * sizeof(ldouble))
+        throw std::runtime_error("Invalid long double in checkpoint: " + s);
+    unsigned char bytes[sizeof(ldouble)];
+    for (auto i = 0u; i < sizeof(ldouble); ++i)
+        bytes[i] = std::strtoul(s.substr(2 * i, 2).c_str(), nullptr, 16);
+    ldouble x;
+    std::memcpy(&x, bytes, sizeof(ldouble));
+    return x;
+}
+
+} // namespace
+
+namespace squares
+{
+namespace detail
+{
+
+Sums load(const std::string &path, double &Tobs, unsigned &N)
+{
+    std::ifstream in(path);
+    if (!in)
+        throw std::runtime_error("Cannot read checkpoint " + path);
+
+    std::string line;
+    if (!std::getline(in, line) || line != magic)
+        throw std::runtime_error("Not a checkpoint file: " + path);
+    if (!std::getline(in, line))
+        throw std::runtime_error("Missing header in checkpoint " + path);
+    {
+        std::istringstream fields(line);
+        std::string T;
+        if (!(fields >> T >> N) || N == 0)
+            throw std::runtime_error("Corrupt header in checkpoint " + path + ": " + line);
+        Tobs = std::strtod(T.c_str(), nullptr);
+        if (line != header(Tobs, N))
+            throw std::runtime_error("Checkpoint " + path + " was written on a different platform: " + line);
+    }
+
+    Sums sums(N + 1);
+    const auto cut = full(N);
+    while (std::getline(in, line))
+    {
+        std::istringstream record(line);
+        unsigned r, Mmax;
+        if (!(record >> r >> Mmax) || r < 1 || r > N || Mmax != cut[r])
+            throw std::runtime_error("Corrupt record in checkpoint " + path + ": " + line);
+        if (!sums[r].empty())
+            throw std::runtime_error("Duplicate record in checkpoint " + path + ": " + line);
+        sums[r].assign(Mmax + 1, 0);
+        std::string bytes;
+        for (auto M = 1u; M <= Mmax; ++M)
+        {
+            if (!(record >> bytes))
+                throw std::runtime_error("Corrupt record in checkpoint " + path + ": " + line);
+            sums[r][M] = from_hex(bytes);
+        }
+    }
+
+    return sums;
+}
+
+void save(const std::string &path, const double Tobs, const unsigned N, const Sums &sums)
+{
+    // write to a temporary file first so an interruption cannot corrupt the checkpoint
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp);
+        out << magic << '\n' << header(Tobs, N) << '\n';
+        for (auto r = 1u; r <= N; ++r)
+        {
+            if (sums[r].empty())
+                continue;
+            out << r << ' ' << sums[r].size() - 1;
+            for (auto M = 1u; M < sums[r].size(); ++M)
+                out << ' ' << to_hex(sums[r][M]);
+            out << '\n';
+        }
+        out.close();
+        if (!out)
+            throw std::runtime_error("Cannot write checkpoint " + tmp);
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0)
+        throw std::runtime_error("Cannot move checkpoint " + tmp + " to " + path);
+}
+
+} // namespace detail
+
+using namespace detail;
+
+double resumable_cumulative(const double Tobs, const unsigned N, const std::string &checkpoint,
+                            const double interval, Executor &executor)
+{
+    Sums sums(N + 1);
+    if (std::ifstream(checkpoint))
+    {
+        double T;
+        unsigned n;
+        sums = load(checkpoint, T, n);
+        if (T != Tobs || n != N)
+            throw std::runtime_error("Checkpoint " + checkpoint + " belongs to a different computation");
+    }
+
+    /*
+     * `done` runs in the parallel region while the other threads wait
+     * for the lock on `sums`. So only copy the sums there and write the
+     * copy in the background. An exception must not escape the
+     * parallel region; a failed write ends checkpointing and is
+     * rethrown at the end.
+     */
+    using clock = std::chrono::steady_clock;
+    auto last = clock::now();
+    std::future<void> writing;
+    std::exception_ptr error;
+    auto finish_writing = [&]()
+    {
+        if (!writing.valid())
+            return;
+        try
+        {
+            writing.get();
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+    };
+    auto done = [&](unsigned)
+    {
+        const auto now = clock::now();
+        if (error || std::chrono::duration<double>(now - last).count() < interval)
+            return;
+        finish_writing();
+        if (error)
+            return;
+        writing = std::async(std::launch::async, save, checkpoint, Tobs, N, sums);
+        last = now;
+    };
+
+    exact_sums(Tobs, N, full(N), sums, done, Precision::extended, executor);
+    finish_writing();
+    if (error)
+        std::rethrow_exception(error);
+
+    save(checkpoint, Tobs, N, sums);
+
+    return combine(N, sums);
+}
+
+} // namespace squares
@@ -0,0 +1,133 @@
+// Copyright 2018 Frederik Beaujean <beaujean@mpp.mpg.de>
+
+#include "squares.h"
+#include "squares_detail.h"
+
+#include <gsl/gsl_randist.h>
+
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+using namespace squares::detail;
+
+namespace
+{
+
+/*
+ * With P_y = P(\chi^2 < Tobs | y) and its density p_y, the derivatives
+ * of the weight W = \prod_l P_l^c_l / c_l! of a partition are
+ *
+ *   W'  = W A,           A = \sum_l c_l a_l,   a_y = p_y / P_y
+ *   W'' = W (A^2 + B),   B = \sum_l c_l b_l,   b_y = p'_y / P_y - a_y^2
+ *
+ * so we only need prefix sums of A and B next to the prefix weight.
+ */
+struct Moments
+{
+    /// sum over partitions of W, W', W'' at index M
+    std::vector<ldouble> s0, s1, s2;
+};
+
+template<class Weight>
+Moments partition_moments(unsigned r, unsigned Mmax, const Weight &weight,
+                          const std::vector<ldouble> &a, const std::vector<ldouble> &b,
+                          const bool second)
+{
+    Moments res{std::vector<ldouble>(Mmax + 1, 0), std::vector<ldouble>(Mmax + 1, 0),
+                std::vector<ldouble>(Mmax + 1, 0)};
+
+    std::vector<ldouble> prefix(Mmax + 1, Weight::one());
+    std::vector<ldouble> A(Mmax + 1, 0);
+    std::vector<ldouble> B(Mmax + 1, 0);
+
+    partitions::PartitionGenerator g(r, Mmax);
+    auto &n = g->mult();
+    auto &y = g->parts();
+    auto &M = g->total_parts();
+
+    for (; g; ++g)
+    {
+        const auto h = g->distinct_parts();
+        for (auto l = g->first_modified(); l <= h; ++l)
+        {
+            prefix[l] = weight(prefix[l - 1], y[l], n[l]);
+            A[l] = A[l - 1] + n[l] * a[y[l]];
+            if (second)
+                B[l] = B[l - 1] + n[l] * b[y[l]];
+        }
+        // same order as `partition_sums`
+        const ldouble W = weight.linear(prefix[h]);
+        res.s0[M] += W;
+        res.s1[M] += W * A[h];
+        if (second)
+            res.s2[M] += W * (A[h] * A[h] + B[h]);
+    }
+    return res;
+}
+
+template<class Weight>
+std::vector<Moments> block_moments(const unsigned N, const Weight &weight, const Cut &cut,
+                                   const std::vector<ldouble> &a, const std::vector<ldouble> &b,
+                                   const bool second, squares::Executor &executor)
+{
+    std::vector<Moments> res(N + 1);
+    executor.parallel_for(N, [&](unsigned i)
+    {
+        const unsigned r = i + 1;
+        res[r] = partition_moments(r, cut[r], weight, a, b, second);
+    });
+    return res;
+}
+
+} // namespace
+
+namespace squares
+{
+
+Density density(const double Tobs, const unsigned N, const bool second, Executor &executor)
+{
+    const auto log_factorial = CacheFactorials(N);
+    const auto log_cumulative = CacheChi2(Tobs, N, executor);
+
+    // ratios of the chi2 density and its derivative to the cumulative
+    std::vector<ldouble> a(N + 1, 0), b(N + 1, 0);
+    for (auto y = 1u; y <= N; ++y)
+    {
+        a[y] = gsl_ran_chisq_pdf(Tobs, y) / std::exp(log_cumulative[y]);
+        b[y] = a[y] * ((0.5L * y - 1) / Tobs - 0.5L) - a[y] * a[y];
+    }
+
+    const auto cut = full(N);
+    std::vector<Moments> moments;
+    if (LinearWeight<ldouble>::representable(log_cumulative, log_factorial))
+        moments = block_moments(N, LinearWeight<ldouble>(log_cumulative, log_factorial), cut, a, b, second,
+                                executor);
+    else
+        moments = block_moments(N, LogWeight{log_cumulative, log_factorial}, cut, a, b, second, executor);
+
+    // F exactly as in `cumulative`. The derivatives may be negative, so
+    // don't go through the log
+    Sums s0(N + 1);
+    std::vector<ldouble> t1, t2;
+    for (auto r = 1u; r <= N; ++r)
+    {
+        s0[r] = moments[r].s0;
+        const auto log_scale = log_scales(N, r, cut[r]);
+        for (auto M = 1u; M <= cut[r]; ++M)
+        {
+            const ldouble scale = std::exp(log_scale[M]);
+            t1.push_back(scale * moments[r].s1[M]);
+            t2.push_back(scale * moments[r].s2[M]);
+        }
+    }
+
+    Density res;
+    res.F = combine(N, s0);
+    res.f = pairwise_sum(t1.data(), t1.data() + t1.size());
+    res.df = second ? double(pairwise_sum(t2.data(), t2.data() + t2.size())) : std::numeric_limits<double>::quiet_NaN();
+
+    return res;
+}
+
+} // namespace squares
@@ -0,0 +1,445 @@
+// Copyright 2018 Frederik Beaujean <beaujean@mpp.mpg.de>
+
+// Internals of the exact cumulative shared by the different front ends.
+
+#pragma once
+
+#include "partitions.h"
+#include "squares.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace squares
+{
+namespace detail
+{
+
+// use ldouble for higher precision when adding lots of numbers
+using ldouble = long double;
+
+/// Return log(n!) for n = 0...N
+std::vector<ldouble> CacheFactorials(unsigned N);
+
+/// Return log(P(\chi^2 < Tobs | i)) for i = 1...N, padded with NaN at i = 0
+std::vector<ldouble> CacheChi2(double Tobs, unsigned N, Executor &executor = openmp());
+
+/// Same as `CacheChi2` but computed as log1p(-Q) to resolve P(\chi^2 < Tobs | i) close to 1
+std::vector<ldouble> CacheChi2Tail(double Tobs, unsigned N, Executor &executor = openmp());
+
+/*
+ * The weight of a partition is the product over its distinct parts
+ * y_l of P(\chi^2 < Tobs | y_l)^c_l / c_l!. The generator only
+ * modifies a suffix of the partition, so we keep the partial products
+ * over the first l distinct parts and update only the modified tail.
+ */
+
+/// Accumulate the weight on log scale, one `exp` per partition.
+struct LogWeight
+{
+    using value_type = ldouble;
+
+    const std::vector<ldouble> &log_cumulative;
+    const std::vector<ldouble> &log_factorial;
+
+    static constexpr ldouble one() { return 0; }
+    ldouble operator()(ldouble prefix, unsigned y, unsigned c) const
+    { return prefix + c * log_cumulative[y] - log_factorial[c]; }
+    ldouble linear(ldouble w) const
+    { return std::exp(w); }
+};
+
+/// Accumulate the weight on linear scale from a table of P(y)^c / c!; no `exp` at all.
+template<class Real>
+struct LinearWeight
+{
+    using value_type = Real;
+
+    LinearWeight(const std::vector<ldouble> &log_cumulative, const std::vector<ldouble> &log_factorial) :
+        offset(log_cumulative.size() + 1)
+    {
+        const unsigned N = log_cumulative.size() - 1;
+        offset[1] = 0;
+        for (auto y = 1u; y <= N; ++y)
+        {
+            offset[y + 1] = offset[y] + N / y;
+            for (auto c = 1u; c <= N / y; ++c)
+                table.push_back(std::exp(c * log_cumulative[y] - log_factorial[c]));
+        }
+    }
+
+    /*
+     * Can every weight be represented without underflow? With m =
+     * min_y log(P(y)) / y, the log weight of any partition of r <= N is
+     * at least r*m - log(r!).
+     */
+    static bool representable(const std::vector<ldouble> &log_cumulative, const std::vector<ldouble> &log_factorial)
+    {
+        const unsigned N = log_cumulative.size() - 1;
+        ldouble m = 0;
+        for (auto y = 1u; y <= N; ++y)
+            m = std::min(m, log_cumulative[y] / y);
+        return N * m - log_factorial[N] > std::log(ldouble(std::numeric_limits<Real>::min()));
+    }
+
+    static constexpr Real one() { return 1; }
+    Real operator()(Real prefix, unsigned y, unsigned c) const
+    { return prefix * table[offset[y] + c - 1]; }
+    Real linear(Real w) const
+    { return w; }
+
+    std::vector<unsigned> offset;
+    std::vector<Real> table;
+};
+
+/*
+ * For the p value, the weight of a partition is (1 - \prod_l
+ * P(y_l)^c_l) / \prod_l c_l!. Keep the two factors apart. The first
+ * is built up from t = 1 - P(y)^c = -expm1(c log1p(-Q(y))) as
+ *
+ *   D' = 1 - (1 - D) P(y)^c = D + (1 - D) t,
+ *
+ * a sum of positive terms, so it has full relative precision even if
+ * every Q(y) is far below the machine epsilon.
+ */
+struct TailWeight
+{
+    struct value_type
+    {
+        ldouble factor;
+        ldouble tail;
+    };
+
+    /// `log_cumulative` has to be accurate for P(y) close to 1, see `CacheChi2Tail`
+    TailWeight(const std::vector<ldouble> &log_cumulative, const std::vector<ldouble> &log_factorial) :
+        offset(log_cumulative.size() + 1),
+        inverse_factorial(log_factorial.size())
+    {
+        for (auto c = 0u; c < log_factorial.size(); ++c)
+            inverse_factorial[c] = std::exp(-log_factorial[c]);
+
+        const unsigned N = log_cumulative.size() - 1;
+        offset[1] = 0;
+        for (auto y = 1u; y <= N; ++y)
+        {
+            offset[y + 1] = offset[y] + N / y;
+            for (auto c = 1u; c <= N / y; ++c)
+                table.push_back(-std::expm1(c * log_cumulative[y]));
+        }
+    }
+
+    static value_type one() { return value_type{1, 0}; }
+    value_type operator()(const value_type &prefix, unsigned y, unsigned c) const
+    {
+        return value_type{prefix.factor * inverse_factorial[c],
+                          prefix.tail + (1 - prefix.tail) * table[offset[y] + c - 1]};
+    }
+    ldouble linear(const value_type &w) const
+    { return w.factor * w.tail; }
+
+    std::vector<unsigned> offset;
+    std::vector<ldouble> inverse_factorial;
+    std::vector<ldouble> table;
+};
+
+/*!
+ * Add up in `double` but keep track of the rounding errors
+ * (Kahan-Babuska). The sum is about as accurate as in `long double`
+ * but without x87 instructions; the weights themselves are only
+ * `double`, so the cumulative can differ from `extended` by a few ulp.
+ */
+class CompensatedSum
+{
+ public:
+  CompensatedSum(double x = 0) :
+      sum(x),
+      c(0)
+  {}
+
+  CompensatedSum &operator+=(double x)
+  {
+      const double t = sum + x;
+      if (std::abs(sum) >= std::abs(x))
+          c += (sum - t) + x;
+      else
+          c += (x - t) + sum;
+      sum = t;
+      return *this;
+  }
+
+  operator ldouble() const
+  { return ldouble(sum) + c; }
+
+ private:
+  double sum, c;
+};
+
+/*!
+ * Sum the weights of all partitions of `r` into `M` parts for `M =
+ * 1...Mmax` in a single pass. The sum for `M` is at index `M`.
+ *
+ * Weights are added up in `Sum`.
+ */
+template<class Weight, class Sum = typename Weight::value_type>
+std::vector<ldouble> partition_sums(unsigned r, unsigned Mmax, const Weight &weight)
+{
+    std::vector<Sum> res(Mmax + 1, Sum(0));
+
+    // at most Mmax distinct parts
+    std::vector<typename Weight::value_type> prefix(Mmax + 1, Weight::one());
+
+    // visit all partitions, save ref to partition
+    partitions::PartitionGenerator g(r, Mmax);
+    auto &n = g->mult();
+    auto &y = g->parts();
+    auto &M = g->total_parts();
+
+    for (; g; ++g)
+    {
+        const auto h = g->distinct_parts();
+        for (auto l = g->first_modified(); l <= h; ++l)
+            prefix[l] = weight(prefix[l - 1], y[l], n[l]);
+        res[M] += weight.linear(prefix[h]);
+    }
+    return std::vector<ldouble>(res.begin(), res.end());
+}
+
+/*!
+ * Bound the weights of all completions of a partition, see `Partition::skip`.
+ *
+ * If the remainder `R` is to be split into `m` parts larger than
+ * `y`, the sum of the weights of all completions is at most the
+ * number of compositions of `R` into such parts, divided by `m!`, times
+ * `P(y + 1)^m`. Everything is tabulated on linear scale so checking is
+ * cheap.
+ */
+struct SubtreeBound
+{
+    SubtreeBound(const std::vector<ldouble> &log_cumulative, const std::vector<ldouble> &log_factorial) :
+        N(log_cumulative.size() - 1),
+        binomial((N + 1) * (N + 1), 0),
+        offset(N + 2, 0)
+    {
+        for (auto a = 0u; a <= N; ++a)
+            for (auto b = 0u; b <= a; ++b)
+                binomial[a * (N + 1) + b] = std::exp(log_factorial[a] - log_factorial[b] - log_factorial[a - b]);
+
+        // P(y)^m / m! for y >= 2 and m*(y-1) <= N
+        for (auto y = 2u; y <= N; ++y)
+        {
+            offset[y + 1] = offset[y] + N / (y - 1);
+            for (auto m = 1u; m <= N / (y - 1); ++m)
+                power.push_back(std::exp(m * log_cumulative[y] - log_factorial[m]));
+        }
+    }
+
+    ldouble operator()(unsigned R, unsigned m, unsigned y) const
+    {
+        const auto free = R - m * y;
+        return binomial[(free - 1) * (N + 1) + m - 1] * power[offset[y + 1] + m - 1];
+    }
+
+    const unsigned N;
+    std::vector<ldouble> binomial;
+    std::vector<unsigned> offset;
+    std::vector<ldouble> power;
+};
+
+/*!
+ * Same as `partition_sums` but skip whole subtrees of the partition
+ * order, see `Partition::skip`, if their contribution to the
+ * cumulative is guaranteed to be less than the remaining `budget`.
+ *
+ * @arg scale The factor in front of the (r, M) block at index M.
+ * @arg budget On output, reduced by the skipped mass.
+ */
+template<class Weight>
+std::vector<ldouble> partition_sums(unsigned r, unsigned Mmax, const Weight &weight,
+                                    const SubtreeBound &completions,
+                                    const std::vector<ldouble> &scale,
+                                    ldouble &budget)
+{
+    std::vector<ldouble> res(Mmax + 1, 0);
+
+    // weight, sum of parts, and number of parts of the first l distinct parts
+    std::vector<typename Weight::value_type> prefix(Mmax + 1, Weight::one());
+    std::vector<unsigned> psum(Mmax + 1, 0);
+    std::vector<unsigned> pcount(Mmax + 1, 0);
+    // how many entries of the prefixes agree with the current partition
+    unsigned valid = 0;
+
+    partitions::PartitionGenerator g(r, Mmax);
+    auto &n = g->mult();
+    auto &y = g->parts();
+    auto &M = g->total_parts();
+
+    for (; g; ++g)
+    {
+        const auto h = g->distinct_parts();
+        for (auto l = std::min(g->first_modified(), valid + 1); l <= h; ++l)
+        {
+            prefix[l] = weight(prefix[l - 1], y[l], n[l]);
+            psum[l] = psum[l - 1] + n[l] * y[l];
+            pcount[l] = pcount[l - 1] + n[l];
+        }
+        valid = h;
+
+        // Subtrees starting before first_modified have been checked
+        // already. Try the largest subtree first. Don't waste the
+        // budget on a subtree with only one part left, it contains
+        // only the current partition.
+        bool skipped = false;
+        for (auto i = g->first_modified(); i < h && M - pcount[i] > 1; ++i)
+        {
+            const ldouble bound = scale[M] * weight.linear(prefix[i]) * completions(r - psum[i], M - pcount[i], y[i]);
+            if (bound <= budget)
+            {
+                budget -= bound;
+                g.skip(i);
+                valid = i;
+                skipped = true;
+                break;
+            }
+        }
+        if (!skipped)
+            res[M] += weight.linear(prefix[h]);
+    }
+    return res;
+}
+
+/// Number of partitions of n into at most k parts at index n * (N + 1) + k
+std::vector<ldouble> partition_counts(const unsigned N);
+
+/// Largest number of parts M for each r = 1...N; 0 to skip r entirely
+using Cut = std::vector<unsigned>;
+
+/// Include all partitions
+Cut full(const unsigned N);
+
+/*!
+ * Skip the (r, M) blocks with the most parts as long as the total
+ * neglected mass stays below `tolerance`. The neglected mass is stored in `neglected`.
+ */
+Cut prune(const unsigned N,
+          const std::vector<ldouble> &log_cumulative,
+          const std::vector<ldouble> &log_factorial,
+          const ldouble tolerance,
+          ldouble &neglected);
+
+/*!
+ * Split `tolerance` into the budgets for skipping subtrees within each
+ * r, see `partition_sums`. The budget is 0 for any r where skipping
+ * is not expected to pay off.
+ */
+std::vector<ldouble> skip_budgets(const unsigned N,
+                                  const std::vector<ldouble> &log_cumulative,
+                                  const std::vector<ldouble> &log_factorial,
+                                  const Cut &cut,
+                                  const ldouble tolerance);
+
+/// Log of the factor in front of the (r, M) block at index M = 1...Mmax
+std::vector<ldouble> log_scales(const unsigned N, const unsigned r, const unsigned Mmax);
+
+/// Sum the range in a fixed binary tree
+ldouble pairwise_sum(const ldouble *first, const ldouble *last);
+
+/// Sums of partition weights of r into M parts at index [r][M]; empty if not computed
+using Sums = std::vector<std::vector<ldouble>>;
+
+/*!
+ * Compute the partition sums of every r for M = 1...cut[r] unless
+ * `sums[r]` is filled already.
+ *
+ * @arg completions If not null, r may skip partitions with a total
+ * contribution up to `budget[r]`.
+ * @arg done If given, called with `r` as soon as `sums[r]` is
+ * available. Calls are serialized with the updates of `sums`.
+ * @return The skipped mass
+ */
+template<class Weight, class Sum = typename Weight::value_type>
+ldouble block_sums(const unsigned N, const Weight &weight, const Cut &cut,
+                   const SubtreeBound *completions,
+                   const std::vector<ldouble> &budget,
+                   Sums &sums,
+                   const std::function<void(unsigned)> &done = nullptr,
+                   Executor &executor = openmp())
+{
+    sums.resize(N + 1);
+    std::vector<ldouble> lost(N + 1, 0);
+    std::mutex mutex;
+
+    executor.parallel_for(N, [&](unsigned i)
+    {
+        const unsigned r = i + 1;
+        // const unsigned long Mmax = (r <= N-r+1)? r : N-r+1;
+        const unsigned long Mmax = cut[r];
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (Mmax == 0 || !sums[r].empty())
+                return;
+        }
+
+        // maintain sum over partitions for every M at once
+        std::vector<ldouble> ppi;
+        if (completions && budget[r] > 0)
+        {
+            std::vector<ldouble> scale = log_scales(N, r, Mmax);
+            for (auto &s : scale)
+                s = std::exp(s);
+            ldouble left = budget[r];
+            ppi = partition_sums(r, Mmax, weight, *completions, scale, left);
+            lost[r] = budget[r] - left;
+        }
+        else
+            ppi = partition_sums<Weight, Sum>(r, Mmax, weight);
+
+        // `done` may read the sums of any r
+        std::lock_guard<std::mutex> lock(mutex);
+        sums[r] = std::move(ppi);
+        if (done)
+            done(r);
+    });
+
+    // independent of the schedule
+    return pairwise_sum(lost.data(), lost.data() + lost.size());
+}
+
+/// Compute the missing sums of `cut` without skipping any partitions
+void exact_sums(const double Tobs, const unsigned N, const Cut &cut, Sums &sums,
+                const std::function<void(unsigned)> &done = nullptr,
+                const Precision precision = Precision::extended,
+                Executor &executor = openmp());
+
+/*!
+ * Add the blocks that are missing for `N` to sums computed for a
+ * smaller number of trials and the same `Tobs`. The existing sums are
+ * kept as they are.
+ */
+void extend_sums(const double Tobs, const unsigned N, Sums &sums, Executor &executor = openmp());
+
+/*!
+ * Combine the partition sums into the cumulative for `N` trials. The
+ * sums don't depend on `N`, so `sums` may come from any `N' >= N`.
+ *
+ * Each sum is computed by one thread, and they are combined in a
+ * fixed order, so the result doesn't depend on the number of threads
+ * or the schedule.
+ */
+ldouble combine(const unsigned N, const Sums &sums);
+
+/// Same as `combine` but return the log of the result to avoid underflow
+ldouble log_combine(const unsigned N, const Sums &sums);
+
+/// Read the sums of a checkpoint file written by `save`
+Sums load(const std::string &path, double &Tobs, unsigned &N);
+
+/// Write all non-empty sums to a checkpoint file
+void save(const std::string &path, const double Tobs, const unsigned N, const Sums &sums);
+
+} // namespace detail
+} // namespace squares
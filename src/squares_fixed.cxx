@@ -0,0 +1,135 @@
+// Copyright 2018 Frederik Beaujean <beaujean@mpp.mpg.de>
+
+#include "squares.h"
+#include "partitions.h"
+
+#include <gsl/gsl_cdf.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using ldouble = long double;
+
+namespace
+{
+
+/*
+ * For fixed N, the cumulative is a polynomial in P(\chi^2 < Tobs | y),
+ * y = 1...N. Each partition of r into M parts contributes
+ *
+ *   exp(scale(r, M)) / \prod_l c_l! * \prod_l P(y_l)^c_l
+ *
+ * so we store the coefficient in front and the index of each power
+ * P(y_l)^c_l in a table of powers that only has to be computed once
+ * per Tobs.
+ */
+
+/// Index of P(y)^1 in the table of powers, P(y)^c is at offset(y) + c - 1
+constexpr unsigned offset(const unsigned y, const unsigned N)
+{
+    return (y <= 1) ? 0 : offset(y - 1, N) + N / (y - 1);
+}
+
+/// Number of powers P(y)^c with y*c <= N
+constexpr unsigned npowers(const unsigned N)
+{
+    return offset(N + 1, N);
+}
+
+struct Table
+{
+    /// coefficient of each term
+    std::vector<ldouble> coef;
+    /// one past the last power of each term in `powers`
+    std::vector<unsigned> end;
+    /// indices into the table of powers
+    std::vector<unsigned short> powers;
+};
+
+Table tabulate(const unsigned N)
+{
+    Table t;
+
+    std::vector<ldouble> log_factorial(N + 1, 0);
+    for (auto i = 1u; i <= N; ++i)
+        log_factorial[i] = log_factorial[i - 1] + std::log(ldouble(i));
+
+    // same as in cumulative
+    const ldouble logpow2N1 = (N <= 63) ? std::log(ldouble((1ul << N) - 1)) : N * std::log(ldouble(2));
+
+    for (auto r = 1u; r <= N; ++r)
+    {
+        const auto Mmax = std::min(r, N - r + 1);
+        ldouble poch = 0;
+        for (auto M = 1u; M <= Mmax; ++M)
+        {
+            poch += std::log(ldouble(N - r + 2 - M));
+            const ldouble scale = poch - logpow2N1;
+
+            for (partitions::KPartitionGenerator g(r, M); g; ++g)
+            {
+                const auto &c = g->mult();
+                const auto &y = g->parts();
+                ldouble logcoef = scale;
+                for (size_t l = 1; l <= g->distinct_parts(); ++l)
+                {
+                    logcoef -= log_factorial[c[l]];
+                    t.powers.push_back(offset(y[l], N) + c[l] - 1);
+                }
+                t.coef.push_back(std::exp(logcoef));
+                t.end.push_back(t.powers.size());
+            }
+        }
+    }
+
+    return t;
+}
+
+} // namespace
+
+namespace squares
+{
+
+double cumulative_tabulated(const double Tobs, const unsigned N)
+{
+    if (N < 1 || N > max_tabulated_N)
+        throw std::invalid_argument("cumulative_tabulated: need 1 <= N <= " + std::to_string(max_tabulated_N)
+                                    + ", got " + std::to_string(N));
+
+    // built on first use of each N
+    static std::once_flag once[max_tabulated_N + 1];
+    static Table tables[max_tabulated_N + 1];
+    std::call_once(once[N], [N] { tables[N] = tabulate(N); });
+    const Table &table = tables[N];
+
+    // table of powers P(\chi^2 < Tobs | y)^c
+    std::vector<ldouble> powers(npowers(N));
+    for (auto y = 1u; y <= N; ++y)
+    {
+        const ldouble P = gsl_cdf_chisq_P(Tobs, y);
+        ldouble x = 1;
+        for (auto c = 1u; c <= N / y; ++c)
+            powers[offset(y, N) + c - 1] = x *= P;
+    }
+
+    // all terms are positive, no exp or log needed
+    ldouble p = 0;
+    const auto *index = table.powers.data();
+    for (size_t k = 0; k < table.coef.size(); ++k)
+    {
+        ldouble term = table.coef[k];
+        for (const auto *stop = table.powers.data() + table.end[k]; index != stop; ++index)
+            term *= powers[*index];
+        p += term;
+    }
+    assert(p < 1);
+
+    return p;
+}
+
+} // namespace squares
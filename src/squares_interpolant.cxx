@@ -0,0 +1,140 @@
+// Copyright 2018 Frederik Beaujean <beaujean@mpp.mpg.de>
+
+#include "squares_approx.h"
+#include "squares.h"
+
+#include <gsl/gsl_math.h>
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <stdexcept>
+
+namespace
+{
+
+constexpr unsigned npoints = 16;
+
+/// Chebyshev points of the first kind on [-1, 1], interior only, so x = 0 is never needed
+inline double node(const unsigned j)
+{
+    return std::cos(M_PI * (j + 0.5) / npoints);
+}
+
+}
+
+namespace squares
+{
+
+CumulativeInterpolant::CumulativeInterpolant(unsigned N, double tolerance, double width, Executor &executor) :
+    n(N),
+    tolerance(tolerance),
+    width(width),
+    executor(executor),
+    ncalls(0)
+{
+    if (!(tolerance > 0) || !(width > 0))
+        throw std::invalid_argument("Need tolerance > 0 and width > 0");
+}
+
+double CumulativeInterpolant::operator()(const double x)
+{
+    if (!(x > 0))
+        throw std::invalid_argument("Need x > 0");
+
+    // insert the cell under the lock but build it outside, so other
+    // threads can build other cells or wait for this one
+    const double k = std::floor(x / width);
+    std::shared_future<Cell> cell;
+    std::promise<Cell> promise;
+    bool owner = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto c = cells.find(k);
+        if (c == cells.end())
+        {
+            cell = promise.get_future().share();
+            cells.emplace(k, cell);
+            owner = true;
+        }
+        else
+            cell = c->second;
+    }
+    if (owner)
+    {
+        Cell panels;
+        try
+        {
+            const auto calls = build(k * width, (k + 1) * width, panels);
+            std::lock_guard<std::mutex> lock(mutex);
+            ncalls += calls;
+        }
+        catch (...)
+        {
+            // don't keep the failure but let the next caller try again
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                cells.erase(k);
+            }
+            promise.set_exception(std::current_exception());
+            throw;
+        }
+        promise.set_value(std::move(panels));
+    }
+
+    // first panel whose upper edge is above x; rounding may put x on the upper edge of the cell
+    const Cell &panels = cell.get();
+    auto p = std::upper_bound(panels.begin(), panels.end(), x,
+                              [](const double y, const Panel &panel) { return y < panel.b; });
+    if (p == panels.end())
+        --p;
+
+    // barycentric formula for Chebyshev points of the first kind
+    const Panel &panel = *p;
+    const double t = (2 * x - panel.a - panel.b) / (panel.b - panel.a);
+    double num = 0, den = 0;
+    for (auto j = 0u; j < npoints; ++j)
+    {
+        const double d = t - node(j);
+        if (d == 0)
+            return panel.F[j];
+        const double w = ((j % 2) ? -1 : 1) * std::sin(M_PI * (j + 0.5) / npoints) / d;
+        num += w * panel.F[j];
+        den += w;
+    }
+    return num / den;
+}
+
+std::size_t CumulativeInterpolant::nodes() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return ncalls;
+}
+
+std::size_t CumulativeInterpolant::build(const double a, const double b, Cell &cell) const
+{
+    Panel panel{a, b, std::vector<double>(npoints)};
+    for (auto j = 0u; j < npoints; ++j)
+        panel.F[j] = cumulative(0.5 * (a + b) + 0.5 * (b - a) * node(j), n, executor);
+
+    // the last two Chebyshev coefficients
+    double c[2] = {0, 0};
+    for (auto k = npoints - 2; k < npoints; ++k)
+    {
+        for (auto j = 0u; j < npoints; ++j)
+            c[k - (npoints - 2)] += panel.F[j] * std::cos(M_PI * k * (j + 0.5) / npoints);
+        c[k - (npoints - 2)] *= 2.0 / npoints;
+    }
+
+    // F has a square-root singularity at 0, don't chase it forever
+    if (std::abs(c[0]) + std::abs(c[1]) <= tolerance || b - a < 1e-6 * width)
+    {
+        cell.push_back(std::move(panel));
+        return npoints;
+    }
+    const double m = 0.5 * (a + b);
+    const auto calls = build(a, m, cell);
+    return npoints + calls + build(m, b, cell);
+}
+
+}
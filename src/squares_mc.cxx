@@ -0,0 +1,534 @@
+// Copyright 2018 Frederik Beaujean <beaujean@mpp.mpg.de>
+
+#include "squares_mc.h"
+
+#include <gsl/gsl_cdf.h>
+#include <gsl/gsl_randist.h>
+#include <gsl/gsl_rng.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+namespace
+{
+
+/// Experiments that share one random stream
+constexpr unsigned batch = 512;
+
+/// Mix the bits to derive independent seeds, see splitmix64
+unsigned long long mix(unsigned long long x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+using Rng = std::unique_ptr<gsl_rng, void (*)(gsl_rng *)>;
+
+Rng stream(const unsigned long seed, const unsigned long b)
+{
+    Rng rng(gsl_rng_alloc(gsl_rng_mt19937), gsl_rng_free);
+    gsl_rng_set(rng.get(), mix(mix(seed) ^ b));
+    return rng;
+}
+
+/// Bits of a Sobol coordinate
+constexpr unsigned bits = 32;
+
+/// `x^e mod p` for polynomials over GF(2) of degree `s`, bit `i` is the coefficient of `x^i`
+std::uint64_t power_mod(std::uint64_t e, const std::uint64_t p, const unsigned s)
+{
+    std::uint64_t res = 1, base = 2;
+    const auto mulmod = [p, s](std::uint64_t a, std::uint64_t b)
+    {
+        std::uint64_t r = 0;
+        for (; b; b >>= 1)
+        {
+            if (b & 1)
+                r ^= a;
+            a <<= 1;
+            if (a >> s & 1)
+                a ^= p;
+        }
+        return r;
+    };
+    for (; e; e >>= 1)
+    {
+        if (e & 1)
+            res = mulmod(res, base);
+        base = mulmod(base, base);
+    }
+    return res;
+}
+
+/// Is `p` of degree `s` primitive; i.e., is the order of `x` modulo `p` equal to `2^s - 1`
+bool primitive(const std::uint64_t p, const unsigned s)
+{
+    const std::uint64_t order = (std::uint64_t(1) << s) - 1;
+    if (power_mod(order, p, s) != 1)
+        return false;
+    std::uint64_t rest = order;
+    for (std::uint64_t q = 2; q * q <= rest; ++q)
+    {
+        if (rest % q)
+            continue;
+        if (power_mod(order / q, p, s) == 1)
+            return false;
+        while (rest % q == 0)
+            rest /= q;
+    }
+    return rest == 1 || power_mod(order / rest, p, s) != 1;
+}
+
+/*!
+ * Direction numbers of a Sobol sequence in `d` dimensions, bit `bits
+ * - 1` is the most significant.
+ *
+ * Dimension 0 is van der Corput, then one primitive polynomial per
+ * dimension in order of increasing degree. Any odd initial direction
+ * numbers `m_k < 2^k` are valid; they are drawn from a fixed stream
+ * so the point set never changes. The scrambling makes up for not
+ * using optimized initial numbers.
+ */
+std::vector<std::uint32_t> directions(const unsigned d)
+{
+    std::vector<std::uint32_t> v(std::size_t(d) * bits);
+    std::uint64_t p = 2;
+    unsigned s = 1;
+    unsigned long long state = 0;
+    for (auto j = 0u; j < d; ++j)
+    {
+        std::uint32_t *vj = &v[std::size_t(j) * bits];
+        if (j == 0)
+        {
+            for (auto k = 0u; k < bits; ++k)
+                vj[k] = std::uint32_t(1) << (bits - 1 - k);
+            continue;
+        }
+        // next primitive polynomial
+        do
+        {
+            if (++p >> (s + 1))
+                ++s;
+        } while (!(p & 1) || !primitive(p, s));
+
+        for (auto k = 0u; k < std::min(s, bits); ++k)
+        {
+            const std::uint32_t m = (mix(state++) & ((std::uint64_t(1) << k) - 1)) << 1 | 1;
+            vj[k] = m << (bits - 1 - k);
+        }
+        for (auto k = s; k < bits; ++k)
+        {
+            vj[k] = vj[k - s] ^ (vj[k - s] >> s);
+            for (auto i = 1u; i < s; ++i)
+            {
+                if (p >> (s - i) & 1)
+                    vj[k] ^= vj[k - i];
+            }
+        }
+    }
+    return v;
+}
+
+/// Apply a random lower-triangular matrix with unit diagonal (Matousek's linear scrambling)
+std::vector<std::uint32_t> scramble(const std::vector<std::uint32_t> &v, const unsigned long long seed)
+{
+    std::vector<std::uint32_t> res(v.size());
+    const unsigned d = v.size() / bits;
+    unsigned long long state = seed;
+    for (auto j = 0u; j < d; ++j)
+    {
+        // row `r` computes output bit `bits - 1 - r` from the same and more significant input bits
+        std::uint32_t row[bits];
+        for (auto r = 0u; r < bits; ++r)
+        {
+            const std::uint32_t diagonal = std::uint32_t(1) << (bits - 1 - r);
+            // a shift by the full width is undefined, so the first row has nothing above
+            const std::uint32_t above = r ? ~std::uint32_t(0) << (bits - r) : 0;
+            row[r] = diagonal | (r ? std::uint32_t(mix(state++)) & above : 0);
+        }
+        for (auto k = 0u; k < bits; ++k)
+        {
+            const std::uint32_t x = v[std::size_t(j) * bits + k];
+            std::uint32_t y = 0;
+            for (auto r = 0u; r < bits; ++r)
+            {
+                std::uint32_t b = row[r] & x;
+                b ^= b >> 16;
+                b ^= b >> 8;
+                b ^= b >> 4;
+                b ^= b >> 2;
+                b ^= b >> 1;
+                y |= (b & 1) << (bits - 1 - r);
+            }
+            res[std::size_t(j) * bits + k] = y;
+        }
+    }
+    return res;
+}
+
+} // namespace
+
+namespace squares
+{
+
+double statistic(const double *z, const unsigned N)
+{
+    double T;
+    statistic(z, N, 1, &T);
+    return T;
+}
+
+void statistic(const double *z, const unsigned N, const unsigned nexp, double *T)
+{
+    std::vector<double> run(nexp, 0);
+    std::fill(T, T + nexp, 0);
+    for (auto i = 0u; i < N; ++i)
+    {
+        const double *zi = z + std::size_t(i) * nexp;
+        // no branches, so the compiler can vectorize
+        for (auto k = 0u; k < nexp; ++k)
+        {
+            run[k] = (zi[k] > 0) ? run[k] + zi[k] * zi[k] : 0;
+            T[k] = std::max(T[k], run[k]);
+        }
+    }
+}
+
+std::vector<double> gaussian_bump(const unsigned N, const double amplitude, const double center, const double width)
+{
+    std::vector<double> res(N);
+    for (auto i = 0u; i < N; ++i)
+        res[i] = amplitude * std::exp(-0.5 * (i - center) * (i - center) / (width * width));
+    return res;
+}
+
+std::vector<double> simulate(const std::vector<double> &shift, const unsigned long nexp,
+                             const unsigned long seed, Executor &executor)
+{
+    return simulate(shift.size(), [&shift](unsigned long, std::vector<double> &s) { s = shift; },
+                    nexp, seed, executor);
+}
+
+std::vector<double> simulate(const unsigned N, const Signal &signal, const unsigned long nexp,
+                             const unsigned long seed, Executor &executor)
+{
+    std::vector<double> T(nexp);
+    const unsigned nbatches = (nexp + batch - 1) / batch;
+
+    // an exception must not escape a parallel region, rethrow the first one afterwards
+    std::exception_ptr error;
+    std::atomic<bool> failed(false);
+    std::mutex mutex;
+
+    executor.parallel_for(nbatches, [&](unsigned b)
+    {
+        if (failed)
+            return;
+        try
+        {
+            const unsigned long first = (unsigned long)(b) * batch;
+            const unsigned n = std::min<unsigned long>(batch, nexp - first);
+
+            auto rng = stream(seed, b);
+            std::vector<double> z(std::size_t(N) * n);
+            std::vector<double> shift(N, 0);
+            for (auto k = 0u; k < n; ++k)
+            {
+                signal(first + k, shift);
+                if (shift.size() != N)
+                    throw std::invalid_argument("Signal has wrong number of bins");
+                for (auto i = 0u; i < N; ++i)
+                    z[std::size_t(i) * n + k] = gsl_ran_gaussian_ziggurat(rng.get(), 1) + shift[i];
+            }
+            statistic(z.data(), N, n, &T[first]);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error)
+                error = std::current_exception();
+            failed = true;
+        }
+    });
+    if (error)
+        std::rethrow_exception(error);
+    return T;
+}
+
+double critical_value(const std::function<double(double)> &F, const double alpha, const double epsrel)
+{
+    if (!(alpha > 0 && alpha < 1))
+        throw std::invalid_argument("Need 0 < alpha < 1");
+    if (!(epsrel > 0))
+        throw std::invalid_argument("Need epsrel > 0");
+
+    // bracket, then bisect. F is monotone in T
+    double lo = 0;
+    double hi = 1;
+    while (1 - F(hi) > alpha)
+    {
+        lo = hi;
+        hi *= 2;
+        if (hi > 1e6)
+            throw std::runtime_error("Cannot find critical value");
+    }
+    while (hi - lo > epsrel * hi)
+    {
+        const double mid = 0.5 * (lo + hi);
+        if (1 - F(mid) > alpha)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return hi;
+}
+
+std::vector<double> power(const std::vector<double> &T,
+                          const std::function<double(double)> &F,
+                          const std::vector<double> &alpha)
+{
+    for (auto a : alpha)
+    {
+        if (!(a > 0 && a < 1))
+            throw std::invalid_argument("Need 0 < alpha < 1");
+    }
+
+    std::vector<double> sorted(T);
+    std::sort(sorted.begin(), sorted.end());
+
+    /*
+     * The critical value only matters up to the next simulated T, so
+     * search for the first experiment with p value <= alpha instead of
+     * solving for the critical value. F is only evaluated at the
+     * O(log(#T)) values of T on the way, shared by all `alpha`.
+     */
+    std::vector<double> cache(sorted.size(), -1);
+    auto pvalue = [&](std::size_t i)
+    {
+        if (cache[i] < 0)
+            cache[i] = 1 - F(sorted[i]);
+        return cache[i];
+    };
+
+    std::vector<double> res;
+    for (auto a : alpha)
+    {
+        std::size_t lo = 0, hi = sorted.size();
+        while (lo < hi)
+        {
+            const auto mid = lo + (hi - lo) / 2;
+            if (pvalue(mid) > a)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        res.push_back(double(sorted.size() - lo) / sorted.size());
+    }
+    return res;
+}
+
+Estimate importance_pvalue(const double Tobs, const unsigned N, const unsigned long nexp,
+                           const double tilt, const unsigned long seed, Executor &executor)
+{
+    if (N == 0 || nexp == 0)
+        throw std::invalid_argument("Need N > 0 and nexp > 0");
+    if (!(tilt > 0))
+        throw std::invalid_argument("Need tilt > 0");
+
+    // The run above `Tobs` may have any length, so mix over
+    // geometrically spaced lengths `L` and all positions. In the run,
+    // draw from `N(theta, sd^2)` such that the sum of squares is
+    // `tilt^2 * Tobs` on average. The extra spread covers runs where
+    // the squares are not evenly distributed.
+    constexpr double sd = 1.2;
+    constexpr double a = 1 / (sd * sd);
+    std::vector<unsigned> lengths;
+    const unsigned Lmax = std::min<double>(N, std::max(1.0, std::ceil(Tobs)));
+    for (double L = 1; L <= Lmax; L = std::max(L + 1, std::round(1.2 * L)))
+        lengths.push_back(L);
+    std::vector<double> theta, offset;
+    for (auto L : lengths)
+    {
+        theta.push_back(tilt * std::sqrt(std::max(Tobs / L + 1 - sd * sd, 0.5)));
+        offset.push_back(L * (0.5 * a * theta.back() * theta.back() + std::log(sd)));
+    }
+
+    // sum of weights and squared weights of each batch, added in fixed order below
+    const unsigned nbatches = (nexp + batch - 1) / batch;
+    std::vector<double> sum(nbatches), sum2(nbatches);
+    executor.parallel_for(nbatches, [&](unsigned b)
+    {
+        const unsigned long first = (unsigned long)(b) * batch;
+        const unsigned n = std::min<unsigned long>(batch, nexp - first);
+
+        auto rng = stream(seed, b);
+        std::vector<double> z(std::size_t(N) * n);
+        for (auto k = 0u; k < n; ++k)
+        {
+            const unsigned j = gsl_rng_uniform_int(rng.get(), lengths.size());
+            const unsigned L = lengths[j];
+            const unsigned pos = gsl_rng_uniform_int(rng.get(), N - L + 1);
+            for (auto i = 0u; i < N; ++i)
+            {
+                const double x = gsl_ran_gaussian_ziggurat(rng.get(), 1);
+                z[std::size_t(i) * n + k] = (i >= pos && i < pos + L) ? sd * x + theta[j] : x;
+            }
+        }
+        std::vector<double> T(n);
+        statistic(z.data(), N, n, T.data());
+
+        // Only experiments above `Tobs` need a weight, copy them together
+        std::vector<unsigned> hits;
+        for (auto k = 0u; k < n; ++k)
+        {
+            if (T[k] >= Tobs)
+                hits.push_back(k);
+        }
+        const unsigned m = hits.size();
+        std::vector<double> y(std::size_t(N) * m);
+        for (auto i = 0u; i < N; ++i)
+        {
+            for (auto k = 0u; k < m; ++k)
+                y[std::size_t(i) * m + k] = z[std::size_t(i) * n + hits[k]];
+        }
+
+        // Ratio of the mixture to the null density. The log ratio of
+        // one component only depends on the sums of `y` and `y^2` in
+        // its window, update them as the window slides
+        std::vector<double> q(m, 0), qL(m), S(m), S2(m);
+        for (auto j = 0u; j < lengths.size(); ++j)
+        {
+            const unsigned L = lengths[j];
+            std::fill(qL.begin(), qL.end(), 0);
+            std::fill(S.begin(), S.end(), 0);
+            std::fill(S2.begin(), S2.end(), 0);
+            for (auto i = 0u; i < N; ++i)
+            {
+                const double *yi = y.data() + std::size_t(i) * m;
+                for (auto k = 0u; k < m; ++k)
+                {
+                    S[k] += yi[k];
+                    S2[k] += yi[k] * yi[k];
+                }
+                if (i >= L)
+                {
+                    const double *yold = yi - std::size_t(L) * m;
+                    for (auto k = 0u; k < m; ++k)
+                    {
+                        S[k] -= yold[k];
+                        S2[k] -= yold[k] * yold[k];
+                    }
+                }
+                if (i + 1 >= L)
+                {
+                    for (auto k = 0u; k < m; ++k)
+                        qL[k] += std::exp(a * theta[j] * S[k] + 0.5 * (1 - a) * S2[k] - offset[j]);
+                }
+            }
+            const double norm = 1.0 / (lengths.size() * (N - L + 1));
+            for (auto k = 0u; k < m; ++k)
+                q[k] += norm * qL[k];
+        }
+
+        for (auto k = 0u; k < m; ++k)
+        {
+            const double w = 1 / q[k];
+            sum[b] += w;
+            sum2[b] += w * w;
+        }
+    });
+
+    double s = 0, s2 = 0;
+    for (auto b = 0u; b < nbatches; ++b)
+    {
+        s += sum[b];
+        s2 += sum2[b];
+    }
+    const double mean = s / nexp;
+    const double var = std::max(0.0, s2 / nexp - mean * mean);
+    return Estimate{mean, std::sqrt(var / nexp)};
+}
+
+Estimate qmc_pvalue(const double Tobs, const unsigned N, const unsigned long npoints,
+                    const unsigned nreplicas, const unsigned long seed, Executor &executor)
+{
+    if (N == 0 || npoints == 0 || nreplicas < 2)
+        throw std::invalid_argument("Need N > 0, npoints > 0, and nreplicas > 1");
+    if (npoints > (unsigned long)(std::numeric_limits<std::uint32_t>::max()))
+        throw std::invalid_argument("Too many points for 32-bit Sobol sequence");
+
+    const auto v = directions(N);
+    const unsigned nbatches = (npoints + batch - 1) / batch;
+
+    // fraction above `Tobs` per replica
+    std::vector<double> p(nreplicas);
+    for (auto rep = 0u; rep < nreplicas; ++rep)
+    {
+        const unsigned long long key = mix(mix(seed) ^ rep);
+        const auto w = scramble(v, key);
+        std::vector<std::uint32_t> shift(N);
+        for (auto j = 0u; j < N; ++j)
+            shift[j] = std::uint32_t(mix(key ^ (j + 1)));
+
+        std::vector<unsigned> above(nbatches);
+        executor.parallel_for(nbatches, [&](unsigned b)
+        {
+            const std::uint32_t first = std::uint32_t(b) * batch;
+            const unsigned n = std::min<unsigned long>(batch, npoints - first);
+
+            // Gray-code order: point `i + 1` differs from point `i` by
+            // the direction number of the lowest zero bit of `i`
+            std::vector<double> z(std::size_t(N) * n);
+            const std::uint32_t gray = first ^ (first >> 1);
+            for (auto j = 0u; j < N; ++j)
+            {
+                const std::uint32_t *wj = &w[std::size_t(j) * bits];
+                std::uint32_t x = shift[j];
+                for (auto k = 0u; k < bits; ++k)
+                {
+                    if (gray >> k & 1)
+                        x ^= wj[k];
+                }
+                double *zj = &z[std::size_t(j) * n];
+                for (auto k = 0u; k < n; ++k)
+                {
+                    zj[k] = gsl_cdf_ugaussian_Pinv((x + 0.5) / 4294967296.0);
+                    unsigned c = 0;
+                    for (std::uint32_t i = first + k; i & 1; i >>= 1)
+                        ++c;
+                    x ^= wj[c];
+                }
+            }
+
+            std::vector<double> T(n);
+            statistic(z.data(), N, n, T.data());
+            above[b] = std::count_if(T.begin(), T.end(), [Tobs](double t) { return t >= Tobs; });
+        });
+
+        unsigned long total = 0;
+        for (auto a : above)
+            total += a;
+        p[rep] = double(total) / npoints;
+    }
+
+    double mean = 0;
+    for (auto x : p)
+        mean += x;
+    mean /= nreplicas;
+    double var = 0;
+    for (auto x : p)
+        var += (x - mean) * (x - mean);
+    var /= nreplicas - 1;
+    return Estimate{mean, std::sqrt(var / nreplicas)};
+}
+
+}
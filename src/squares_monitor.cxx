@@ -0,0 +1,98 @@
+// Copyright 2018 Frederik Beaujean <beaujean@mpp.mpg.de>
+
+#include "squares_monitor.h"
+#include "squares.h"
+#include "squares_detail.h"
+
+#include <cmath>
+#include <stdexcept>
+
+namespace squares
+{
+
+Monitor::Monitor(unsigned Nexact, double epsrel, double epsabs, Executor &executor) :
+    Nexact(Nexact),
+    epsrel(epsrel),
+    epsabs(epsabs),
+    executor(executor),
+    n(0),
+    T(0),
+    best_begin(0),
+    best_end(0),
+    chi2(0),
+    begin(0),
+    F(0),
+    Tsums(-1),
+    Tsplit(-1),
+    Fsplit(0),
+    Dsplit(0)
+{
+    if (Nexact == 0)
+        throw std::invalid_argument("Need Nexact > 0");
+}
+
+double Monitor::add(const double x, const double mu, const double sigma)
+{
+    const double z = (x - mu) / sigma;
+    if (z > 0)
+    {
+        chi2 += z * z;
+        if (chi2 > T)
+        {
+            T = chi2;
+            best_begin = begin;
+            best_end = n + 1;
+        }
+    }
+    else
+    {
+        chi2 = 0;
+        begin = n + 1;
+    }
+    ++n;
+
+    update();
+
+    return pvalue();
+}
+
+void Monitor::update()
+{
+    // no success yet: P(T < 0) = 0
+    if (T <= 0)
+    {
+        F = 0;
+        return;
+    }
+
+    if (n <= Nexact)
+    {
+        if (T != Tsums)
+        {
+            sums.clear();
+            Tsums = T;
+        }
+        detail::extend_sums(T, n, sums, executor);
+        F = detail::combine(n, sums);
+        return;
+    }
+
+    // don't need the exact sums anymore
+    if (!sums.empty())
+    {
+        sums.clear();
+        sums.shrink_to_fit();
+        Tsums = -1;
+    }
+
+    if (T != Tsplit)
+    {
+        Fsplit = squares::cumulative(T, Nexact, executor);
+        Dsplit = Delta(T, Nexact, Nexact, epsrel, epsabs);
+        Tsplit = T;
+    }
+    // same as approx_cumulative
+    F = Fsplit * std::pow(Fsplit / (1 + Dsplit), double(n) / Nexact - 1);
+}
+
+}
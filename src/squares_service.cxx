@@ -0,0 +1,524 @@
+// Copyright 2018 Frederik Beaujean <beaujean@mpp.mpg.de>
+
+#include "squares_service.h"
+#include "squares.h"
+#include "squares_approx.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+
+/*
+ * The protocol is line based. The client writes one query per line,
+ * then closes its end for writing. The server answers with one line
+ * per query in the same order. Floating-point numbers are sent in
+ * hex format to transfer them without loss.
+ *
+ * c Tobs N      -> cumulative(Tobs, N)
+ * p Tobs N      -> pvalue(Tobs, N)
+ * a Tobs N n    -> approx_cumulative(Tobs, N, n)
+ * quit          -> stop the server
+ */
+
+std::runtime_error system_error(const std::string &what)
+{
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+sockaddr_un address(const std::string &path)
+{
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+        throw std::invalid_argument("Socket path too long: " + path);
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    return addr;
+}
+
+std::string hex(double x)
+{
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "%a", x);
+    return buf;
+}
+
+std::string read_all(int fd)
+{
+    std::string res;
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) != 0)
+    {
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            throw system_error("read");
+        }
+        res.append(buf, n);
+    }
+    return res;
+}
+
+void write_all(int fd, const std::string &s)
+{
+    const char *p = s.data();
+    auto left = s.size();
+    while (left > 0)
+    {
+        const auto n = write(fd, p, left);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            throw system_error("write");
+        }
+        p += n;
+        left -= n;
+    }
+}
+
+/// Send `request` and return the entire reply.
+std::string transact(const std::string &path, const std::string &request)
+{
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        throw system_error("socket");
+
+    const auto addr = address(path);
+    std::string reply;
+    try
+    {
+        if (connect(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) < 0)
+            throw system_error("connect to " + path);
+        write_all(fd, request);
+        shutdown(fd, SHUT_WR);
+        reply = read_all(fd);
+    }
+    catch (...)
+    {
+        close(fd);
+        throw;
+    }
+    close(fd);
+    return reply;
+}
+
+squares::Query parse(const std::string &line, const unsigned max_N)
+{
+    std::istringstream in(line);
+    std::string kind, Tobs, n;
+    unsigned N = 0;
+    in >> kind >> Tobs >> N;
+    if (!in || kind.size() != 1)
+        throw std::invalid_argument("Malformed query: " + line);
+
+    squares::Query q{squares::Query::Kind(kind[0]), std::strtod(Tobs.c_str(), nullptr), N, 1};
+    switch (q.kind)
+    {
+    case squares::Query::cdf:
+    case squares::Query::pval:
+        break;
+    case squares::Query::approx:
+        if (!(in >> n))
+            throw std::invalid_argument("Missing n in query: " + line);
+        q.n = std::strtod(n.c_str(), nullptr);
+        break;
+    default:
+        throw std::invalid_argument("Unknown query: " + line);
+    }
+    if (!std::isfinite(q.Tobs) || !std::isfinite(q.n))
+        throw std::invalid_argument("Need finite numbers in query: " + line);
+    if (q.N == 0)
+        throw std::invalid_argument("Need N > 0 in query: " + line);
+    if (q.N > max_N)
+        throw std::invalid_argument("N exceeds the limit of " + std::to_string(max_N) + " in query: " + line);
+
+    return q;
+}
+
+std::string format(const squares::Query &q)
+{
+    std::string res(1, char(q.kind));
+    res += " " + hex(q.Tobs) + " " + std::to_string(q.N);
+    if (q.kind == squares::Query::approx)
+        res += " " + hex(q.n);
+    return res + "\n";
+}
+
+} // namespace
+
+namespace squares
+{
+
+bool operator<(const Query &a, const Query &b)
+{
+    return std::make_tuple(a.kind, a.Tobs, a.N, a.n) < std::make_tuple(b.kind, b.Tobs, b.N, b.n);
+}
+
+double evaluate(const Query &q, Executor &executor)
+{
+    switch (q.kind)
+    {
+    case Query::cdf:
+        return cumulative(q.Tobs, q.N, executor);
+    case Query::pval:
+        return pvalue(q.Tobs, q.N, executor);
+    case Query::approx:
+        return approx_cumulative(q.Tobs, q.N, q.n, EPSREL, EPSABS, executor);
+    }
+    throw std::invalid_argument("Unknown query kind");
+}
+
+ThreadPool::ThreadPool(unsigned nthreads) :
+    stop(false)
+{
+    if (nthreads == 0)
+        nthreads = std::max(1u, std::thread::hardware_concurrency());
+    for (auto i = 0u; i < nthreads; ++i)
+        workers.emplace_back(&ThreadPool::work, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    cv.notify_all();
+    for (auto &w : workers)
+        w.join();
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push(std::move(task));
+    }
+    cv.notify_one();
+}
+
+void ThreadPool::parallel_for(unsigned n, const std::function<void(unsigned)> &task)
+{
+    // shared with helpers that may only start after we have returned
+    struct Loop
+    {
+        std::function<void(unsigned)> task;
+        std::atomic<unsigned> next;
+        unsigned done;
+        std::exception_ptr error;
+        std::mutex mutex;
+        std::condition_variable cv;
+    };
+    auto loop = std::make_shared<Loop>();
+    loop->task = task;
+    loop->next = 0;
+    loop->done = 0;
+
+    auto run = [loop, n]
+    {
+        unsigned count = 0;
+        for (unsigned i; (i = loop->next++) < n; ++count)
+        {
+            try
+            {
+                loop->task(i);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(loop->mutex);
+                if (!loop->error)
+                    loop->error = std::current_exception();
+            }
+        }
+        if (count == 0)
+            return;
+        std::lock_guard<std::mutex> lock(loop->mutex);
+        loop->done += count;
+        if (loop->done == n)
+            loop->cv.notify_all();
+    };
+
+    for (auto k = 1u; k < std::min<std::size_t>(n, workers.size() + 1); ++k)
+        submit(run);
+    run();
+
+    std::unique_lock<std::mutex> lock(loop->mutex);
+    loop->cv.wait(lock, [&] { return loop->done == n; });
+    if (loop->error)
+        std::rethrow_exception(loop->error);
+}
+
+void ThreadPool::work()
+{
+    for (;;)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this] { return stop || !tasks.empty(); });
+            if (tasks.empty())
+                return;
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+        task();
+    }
+}
+
+QueryCache::QueryCache(std::size_t capacity, ThreadPool &pool) :
+    capacity(capacity),
+    pool(pool),
+    nhits(0),
+    nmisses(0)
+{
+}
+
+std::vector<double> QueryCache::operator()(const std::vector<Query> &queries)
+{
+    std::vector<std::shared_future<double>> futures;
+    futures.reserve(queries.size());
+    for (const auto &q : queries)
+        futures.push_back(lookup(q));
+
+    std::vector<double> res;
+    res.reserve(queries.size());
+    for (auto &f : futures)
+        res.push_back(f.get());
+    return res;
+}
+
+std::shared_future<double> QueryCache::lookup(const Query &query)
+{
+    // `n` doesn't matter for the exact kinds, so it mustn't split the cache
+    Query q = query;
+    if (q.kind != Query::approx)
+        q.n = 1;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto cached = index.find(q);
+    if (cached != index.end())
+    {
+        ++nhits;
+        lru.splice(lru.begin(), lru, cached->second);
+        std::promise<double> ready;
+        ready.set_value(cached->second->second);
+        return ready.get_future().share();
+    }
+
+    // coalesce with an identical query that is already being evaluated
+    auto running = in_flight.find(q);
+    if (running != in_flight.end())
+    {
+        ++nhits;
+        return running->second;
+    }
+
+    ++nmisses;
+    auto task = std::make_shared<std::packaged_task<double()>>([this, q]
+    {
+        double value;
+        try
+        {
+            // the worker joins the loop over r instead of opening an OpenMP region
+            value = evaluate(q, pool);
+        }
+        catch (...)
+        {
+            // don't cache failures but let the next caller try again
+            std::lock_guard<std::mutex> lock(mutex);
+            in_flight.erase(q);
+            throw;
+        }
+        store(q, value);
+        return value;
+    });
+    auto future = task->get_future().share();
+    in_flight[q] = future;
+    pool.submit([task] { (*task)(); });
+
+    return future;
+}
+
+void QueryCache::store(const Query &q, double value)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    in_flight.erase(q);
+    if (capacity == 0 || index.count(q))
+        return;
+
+    lru.emplace_front(q, value);
+    index[q] = lru.begin();
+    if (lru.size() > capacity)
+    {
+        index.erase(lru.back().first);
+        lru.pop_back();
+    }
+}
+
+std::size_t QueryCache::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return lru.size();
+}
+
+std::size_t QueryCache::hits() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return nhits;
+}
+
+std::size_t QueryCache::misses() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return nmisses;
+}
+
+void serve(const std::string &path, std::size_t capacity, unsigned nthreads, unsigned max_N)
+{
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        throw system_error("socket");
+
+    const auto addr = address(path);
+    unlink(path.c_str());
+    if (bind(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0)
+    {
+        close(fd);
+        throw system_error("bind to " + path);
+    }
+
+    // a client asking to quit writes to this pipe to wake up the accept loop
+    int wake[2];
+    if (pipe(wake) < 0)
+    {
+        close(fd);
+        throw system_error("pipe");
+    }
+
+    {
+        ThreadPool pool(nthreads);
+        QueryCache cache(capacity, pool);
+
+        // A bounded number of threads reads the queries and waits for
+        // the results, the actual work happens on `pool`. Declared last
+        // so its pending connections are answered before `cache` goes away.
+        ThreadPool connections(pool.size());
+
+        while (true)
+        {
+            pollfd fds[2] = {{fd, POLLIN, 0}, {wake[0], POLLIN, 0}};
+            if (poll(fds, 2, -1) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                break;
+            }
+            if (fds[1].revents)
+                break;
+            if (!(fds[0].revents & POLLIN))
+                continue;
+
+            const int client = accept(fd, nullptr, nullptr);
+            if (client < 0)
+            {
+                if (errno == EINTR || errno == ECONNABORTED || errno == EAGAIN)
+                    continue;
+                break;
+            }
+
+            connections.submit([&, client]
+            {
+                std::string reply;
+                try
+                {
+                    std::istringstream request(read_all(client));
+                    std::vector<Query> queries;
+                    std::string line;
+                    bool quit = false;
+                    while (std::getline(request, line))
+                    {
+                        if (line.empty())
+                            continue;
+                        if (line == "quit")
+                            quit = true;
+                        else
+                            queries.push_back(parse(line, max_N));
+                    }
+                    for (auto x : cache(queries))
+                        reply += hex(x) + "\n";
+
+                    if (quit)
+                    {
+                        const char byte = 0;
+                        while (write(wake[1], &byte, 1) < 0 && errno == EINTR)
+                            ;
+                    }
+                }
+                catch (const std::exception &e)
+                {
+                    reply = std::string("error ") + e.what() + "\n";
+                }
+                try
+                {
+                    write_all(client, reply);
+                }
+                catch (const std::exception &)
+                {
+                    // client went away, nothing to do
+                }
+                close(client);
+            });
+        }
+    }
+
+    close(wake[0]);
+    close(wake[1]);
+    close(fd);
+    unlink(path.c_str());
+}
+
+std::vector<double> remote(const std::string &path, const std::vector<Query> &queries)
+{
+    std::string request;
+    for (const auto &q : queries)
+        request += format(q);
+
+    std::istringstream reply(transact(path, request));
+    std::vector<double> res;
+    res.reserve(queries.size());
+    std::string line;
+    while (std::getline(reply, line))
+    {
+        if (line.compare(0, 5, "error") == 0)
+            throw std::runtime_error("Server at " + path + " replied: " + line);
+        res.push_back(std::strtod(line.c_str(), nullptr));
+    }
+    if (res.size() != queries.size())
+        throw std::runtime_error("Incomplete reply from server at " + path);
+
+    return res;
+}
+
+void shutdown(const std::string &path)
+{
+    transact(path, "quit\n");
+}
+
+} // namespace squares
@@ -0,0 +1,121 @@
+// Copyright 2018 Frederik Beaujean <beaujean@mpp.mpg.de>
+
+#include "squares.h"
+#include "squares_detail.h"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <stdexcept>
+
+namespace squares
+{
+
+using namespace detail;
+
+std::vector<unsigned> shards(const unsigned N, const unsigned nshards)
+{
+    if (nshards == 0)
+        throw std::invalid_argument("Need at least one shard");
+
+    // the cost of r is roughly the number of partitions to visit
+    const auto count = partition_counts(N);
+    const auto cut = full(N);
+    std::vector<std::pair<ldouble, unsigned>> cost;
+    for (auto r = 1u; r <= N; ++r)
+        cost.emplace_back(count[r * (N + 1) + cut[r]], r);
+
+    // most expensive first to the least loaded shard. Ties are broken
+    // by r and shard number, so every process gets the same answer
+    std::sort(cost.begin(), cost.end(), [](const std::pair<ldouble, unsigned> &a,
+                                           const std::pair<ldouble, unsigned> &b)
+              { return a.first > b.first || (a.first == b.first && a.second < b.second); });
+
+    using Load = std::pair<ldouble, unsigned>;
+    std::priority_queue<Load, std::vector<Load>, std::greater<Load>> load;
+    for (auto k = 0u; k < nshards; ++k)
+        load.emplace(0, k);
+
+    std::vector<unsigned> res(N + 1, nshards);
+    for (const auto &c : cost)
+    {
+        auto l = load.top();
+        load.pop();
+        res[c.second] = l.second;
+        l.first += c.first;
+        load.push(l);
+    }
+    return res;
+}
+
+void cumulative_shard(const double Tobs, const unsigned N, const unsigned shard, const unsigned nshards,
+                      const std::string &output, Executor &executor)
+{
+    if (!(Tobs > 0) || !std::isfinite(Tobs))
+        throw std::invalid_argument("Need finite Tobs > 0");
+    if (N == 0)
+        throw std::invalid_argument("Need N > 0");
+    if (shard >= nshards)
+        throw std::invalid_argument("Need shard < nshards");
+
+    // only do the r of this shard
+    const auto assignment = shards(N, nshards);
+    auto cut = full(N);
+    for (auto r = 1u; r <= N; ++r)
+        if (assignment[r] != shard)
+            cut[r] = 0;
+
+    Sums sums;
+    exact_sums(Tobs, N, cut, sums, nullptr, Precision::extended, executor);
+
+    save(output, Tobs, N, sums);
+}
+
+double merge_shards(const std::vector<std::string> &inputs, double *Tobs, unsigned *N)
+{
+    if (inputs.empty())
+        throw std::invalid_argument("No shards to merge");
+
+    double T0 = 0;
+    unsigned N0 = 0;
+    Sums sums;
+    for (const auto &path : inputs)
+    {
+        double T;
+        unsigned n;
+        const auto shard = load(path, T, n);
+        if (sums.empty())
+        {
+            T0 = T;
+            N0 = n;
+            sums.resize(N0 + 1);
+        }
+        else if (T != T0 || n != N0)
+            throw std::runtime_error("Shard " + path + " belongs to a different computation than " + inputs.front());
+
+        for (auto r = 1u; r <= N0; ++r)
+        {
+            if (shard[r].empty())
+                continue;
+            if (!sums[r].empty())
+                throw std::runtime_error("r = " + std::to_string(r) + " found twice, again in " + path);
+            sums[r] = shard[r];
+        }
+    }
+
+    std::string missing;
+    for (auto r = 1u; r <= N0; ++r)
+        if (sums[r].empty())
+            missing += " " + std::to_string(r);
+    if (!missing.empty())
+        throw std::runtime_error("Incomplete shards, missing r =" + missing);
+
+    if (Tobs)
+        *Tobs = T0;
+    if (N)
+        *N = N0;
+
+    return combine(N0, sums);
+}
+
+} // namespace squares
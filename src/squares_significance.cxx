@@ -0,0 +1,139 @@
+// Copyright 2018 Frederik Beaujean <beaujean@mpp.mpg.de>
+
+#include "squares.h"
+#include "squares_detail.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace squares::detail;
+
+namespace
+{
+
+/// Bounds on the contribution of one r to the cumulative before it is computed
+struct Pending
+{
+    unsigned r;
+    ldouble lower, upper;
+    /// number of partitions to visit
+    ldouble cost;
+};
+
+/*
+ * Refine the bounds on F, most uncertainty per partition first, in
+ * rounds that double the work done so far until the bounds are on
+ * one side of 1 - alpha. Returns true if F > 1 - alpha.
+ */
+template<class Weight>
+bool decide(const unsigned N, const ldouble threshold, const Weight &weight,
+            std::vector<Pending> &pending, ldouble &lower, ldouble &upper, squares::Executor &executor)
+{
+    std::sort(pending.begin(), pending.end(), [](const Pending &a, const Pending &b)
+              { return (a.upper - a.lower) / a.cost > (b.upper - b.lower) / b.cost; });
+
+    ldouble done = 0;
+    auto next = pending.begin();
+    while (next != pending.end())
+    {
+        if (lower > threshold || upper <= threshold)
+            break;
+
+        auto end = next;
+        ldouble cost = 0;
+        while (end != pending.end() && (cost == 0 || cost < done))
+            cost += (end++)->cost;
+        done += cost;
+
+        const unsigned n = end - next;
+        std::vector<ldouble> exact(n);
+        executor.parallel_for(n, [&](unsigned i)
+        {
+            const unsigned r = next[i].r;
+            const unsigned Mmax = std::min(r, N - r + 1);
+            const auto ppi = partition_sums(r, Mmax, weight);
+            const auto log_scale = log_scales(N, r, Mmax);
+            for (auto M = 1u; M <= Mmax; ++M)
+                exact[i] += std::exp(log_scale[M]) * ppi[M];
+        });
+        for (auto i = 0u; i < n; ++i)
+        {
+            lower += exact[i] - next[i].lower;
+            upper += exact[i] - next[i].upper;
+        }
+        next = end;
+    }
+    return lower > threshold;
+}
+
+} // namespace
+
+namespace squares
+{
+
+bool is_significant(const double Tobs, const unsigned N, const double alpha, double *lower, double *upper,
+                    Executor &executor)
+{
+    if (!(alpha > 0 && alpha < 1))
+        throw std::invalid_argument("Need 0 < alpha < 1");
+
+    // 1 - F cannot resolve such small p values
+    if (alpha < 1e-10)
+    {
+        const double p = std::exp(log_pvalue(Tobs, N));
+        if (lower)
+            *lower = p;
+        if (upper)
+            *upper = p;
+        return p < alpha;
+    }
+
+    const auto log_factorial = CacheFactorials(N);
+    const auto log_cumulative = CacheChi2(Tobs, N, executor);
+    const auto counts = partition_counts(N);
+
+    /*
+     * P(y) decreases with y. Every part of a partition of r into M is
+     * at most r - M + 1 and the largest is at least ceil(r / M), so
+     * its weight is between P(r - M + 1)^M / \prod c! and P(1)^(M-1)
+     * P(ceil(r / M)) / \prod c!. The sum of 1 / \prod c! over all
+     * partitions is the number of compositions of r into M parts
+     * divided by M!.
+     */
+    std::vector<Pending> pending;
+    ldouble F_lower = 0, F_upper = 0;
+    for (auto r = 1u; r <= N; ++r)
+    {
+        const unsigned Mmax = std::min(r, N - r + 1);
+        const auto log_scale = log_scales(N, r, Mmax);
+        Pending p{r, 0, 0, counts[r * (N + 1) + Mmax]};
+        for (auto M = 1u; M <= Mmax; ++M)
+        {
+            const ldouble log_compositions = log_scale[M] + log_factorial[r - 1] - log_factorial[M - 1]
+                                             - log_factorial[r - M] - log_factorial[M];
+            p.lower += std::exp(log_compositions + M * log_cumulative[r - M + 1]);
+            p.upper += std::exp(log_compositions + (M - 1) * log_cumulative[1]
+                                + log_cumulative[(r + M - 1) / M]);
+        }
+        F_lower += p.lower;
+        F_upper += p.upper;
+        pending.push_back(p);
+    }
+
+    const ldouble threshold = 1 - ldouble(alpha);
+    bool res;
+    if (LinearWeight<ldouble>::representable(log_cumulative, log_factorial))
+        res = decide(N, threshold, LinearWeight<ldouble>(log_cumulative, log_factorial), pending, F_lower, F_upper,
+                     executor);
+    else
+        res = decide(N, threshold, LogWeight{log_cumulative, log_factorial}, pending, F_lower, F_upper, executor);
+
+    if (lower)
+        *lower = std::max(ldouble(0), 1 - F_upper);
+    if (upper)
+        *upper = std::min(ldouble(1), 1 - F_lower);
+    return res;
+}
+
+}
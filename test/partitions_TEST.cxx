@@ -52,3 +52,87 @@ TEST(partitions_test, kpartition)
     check(g, {1,1,1}, {1,2,3});
     check(g, {3}, {2});
 }
+
+template<class G>
+void check_first_modified(G g)
+{
+    auto c = g->mult();
+    auto y = g->parts();
+    for (++g; g; ++g)
+    {
+        const auto f = g->first_modified();
+        ASSERT_GE(f, 1u);
+        for (size_t i = 1; i < f; ++i)
+        {
+            EXPECT_EQ(g->mult()[i], c[i]) << " at index " << i << " in " << *g;
+            EXPECT_EQ(g->parts()[i], y[i]) << " at index " << i << " in " << *g;
+        }
+        c = g->mult();
+        y = g->parts();
+    }
+}
+
+TEST(partitions_test, first_modified)
+{
+    check_first_modified(PartitionGenerator(15));
+    for (UInt_t k = 1; k <= 15; ++k)
+        check_first_modified(KPartitionGenerator(15, k));
+}
+
+TEST(partitions_test, max_parts)
+{
+    // a single pass yields the same as one KPartitionGenerator for each k
+    constexpr UInt_t n = 12;
+    constexpr UInt_t kmax = 5;
+    PartitionGenerator g(n, kmax);
+    for (UInt_t k = 1; k <= kmax; ++k)
+    {
+        for (KPartitionGenerator gk(n, k); gk; ++gk, ++g)
+        {
+            ASSERT_TRUE(bool(g));
+            EXPECT_EQ(*g, *gk);
+            EXPECT_EQ(g->total_parts(), k);
+        }
+    }
+    EXPECT_FALSE(bool(g));
+}
+
+// does `p` agree with `ref` in the first `i` distinct parts, all other parts being larger?
+bool same_subtree(const Partition &p, const Partition &ref, UInt_t i)
+{
+    if (p.total_parts() != ref.total_parts() || p.distinct_parts() <= i)
+        return false;
+    for (UInt_t l = 1; l <= i; ++l)
+    {
+        if (p.mult()[l] != ref.mult()[l] || p.parts()[l] != ref.parts()[l])
+            return false;
+    }
+    return p.parts()[i + 1] > ref.parts()[i];
+}
+
+TEST(partitions_test, skip)
+{
+    constexpr UInt_t n = 14;
+    for (PartitionGenerator g(n); g; ++g)
+    {
+        for (UInt_t i = 1; i < g->distinct_parts(); ++i)
+        {
+            // brute force: find first partition that doesn't share the beginning
+            auto expected = g;
+            while (expected && same_subtree(*expected, *g, i))
+                ++expected;
+
+            auto skipped = g;
+            skipped.skip(i);
+            EXPECT_TRUE(same_subtree(*skipped, *g, i));
+            ++skipped;
+
+            ASSERT_EQ(bool(skipped), bool(expected)) << "skip " << i << " at " << *g;
+            if (expected)
+            {
+                EXPECT_EQ(*skipped, *expected) << "skip " << i << " at " << *g;
+                EXPECT_EQ(skipped->total_parts(), expected->total_parts());
+            }
+        }
+    }
+}
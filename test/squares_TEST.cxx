@@ -1,6 +1,24 @@
 #include "squares.h"
 #include "gtest/gtest.h"
 
+#include <gsl/gsl_cdf.h>
+#include <gsl/gsl_randist.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 using namespace squares;
 
 // compare with Table 1 from paper
@@ -31,3 +49,321 @@ TEST(squares_test, critical)
     EXPECT_NEAR(pvalue(19.645, 2*N), 0.01, 3e-5);
     EXPECT_NEAR(pvalue(15.34, 2*N), 0.05, 1e-4);
 }
+
+TEST(squares_test, fixed)
+{
+    for (auto T : {0.5, 2., 5., 10., 20., 50.})
+    {
+        EXPECT_NEAR(cumulative_tabulated(T, 1), cumulative(T, 1), 1e-15);
+        EXPECT_NEAR(cumulative_tabulated(T, 5), cumulative(T, 5), 1e-15);
+        EXPECT_NEAR(cumulative_tabulated(T, 20), cumulative(T, 20), 1e-15);
+        EXPECT_NEAR(cumulative_tabulated(T, max_tabulated_N), cumulative(T, max_tabulated_N), 1e-15);
+    }
+    EXPECT_THROW(cumulative_tabulated(1, 0), std::invalid_argument);
+    EXPECT_THROW(cumulative_tabulated(1, max_tabulated_N + 1), std::invalid_argument);
+}
+
+TEST(squares_test, tolerance)
+{
+    constexpr unsigned N = 60;
+    constexpr double tolerance = 1e-12;
+    for (auto T : {3., 10., 20.})
+    {
+        const double exact = cumulative(T, N);
+        double bound = -1;
+        const double approx = cumulative(T, N, tolerance, &bound);
+
+        // some partitions are skipped
+        EXPECT_GT(bound, 0) << " at T = " << T;
+        EXPECT_LE(bound, tolerance);
+        EXPECT_LE(approx, exact + 1e-15);
+        EXPECT_LE(exact, approx + bound + 1e-15);
+    }
+
+    // exact if no tolerance
+    double bound = -1;
+    EXPECT_EQ(cumulative(10, N, 0, &bound), cumulative(10, N));
+    EXPECT_EQ(bound, 0);
+}
+
+TEST(squares_test, tolerance_timing)
+{
+    auto seconds = [](const std::function<void()> &f)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        f();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    // the tolerance never costs time even where little can be skipped.
+    // Alternate the two and take the best of five against noise
+    constexpr unsigned N = 70;
+    for (auto T : {3., 10., 30.})
+    {
+        double exact = std::numeric_limits<double>::infinity(), approx = exact;
+        for (auto i = 0; i < 5; ++i)
+        {
+            exact = std::min(exact, seconds([&] { cumulative(T, N); }));
+            approx = std::min(approx, seconds([&] { cumulative(T, N, 1e-12); }));
+        }
+        EXPECT_LT(approx, 1.2 * exact) << " at T = " << T;
+    }
+}
+
+TEST(squares_test, checkpoint)
+{
+    constexpr unsigned N = 40;
+    constexpr double T = 8;
+    const std::string path = "squares_checkpoint_TEST.txt";
+    std::remove(path.c_str());
+
+    // save after every r
+    const double exact = cumulative(T, N);
+    EXPECT_EQ(resumable_cumulative(T, N, path, 0), exact);
+
+    // pretend we were interrupted after the first lines
+    std::string content, line;
+    {
+        std::ifstream in(path);
+        for (auto i = 0; i < 12 && std::getline(in, line); ++i)
+            content += line + "\n";
+    }
+    {
+        std::ofstream out(path);
+        out << content;
+    }
+    EXPECT_EQ(resumable_cumulative(T, N, path), exact);
+
+    // refuse to mix different computations
+    EXPECT_THROW(resumable_cumulative(T + 1, N, path), std::runtime_error);
+    EXPECT_THROW(resumable_cumulative(T, N + 1, path), std::runtime_error);
+
+    // a checkpoint that cannot be written during the computation
+    EXPECT_THROW(resumable_cumulative(T, N, "no_such_directory/" + path, 0), std::runtime_error);
+
+    std::remove(path.c_str());
+}
+
+TEST(squares_test, shards)
+{
+    constexpr unsigned N = 40;
+    constexpr double T = 8;
+    constexpr unsigned nshards = 3;
+
+    // every r in exactly one shard
+    const auto assignment = shards(N, nshards);
+    ASSERT_EQ(assignment.size(), N + 1);
+    for (auto r = 1u; r <= N; ++r)
+        EXPECT_LT(assignment[r], nshards);
+    EXPECT_EQ(shards(N, nshards), assignment);
+
+    std::vector<std::string> paths;
+    for (auto k = 0u; k < nshards; ++k)
+    {
+        paths.push_back("squares_shard_TEST" + std::to_string(k) + ".txt");
+        cumulative_shard(T, N, k, nshards, paths.back());
+    }
+
+    double Tobs = 0;
+    unsigned n = 0;
+    EXPECT_EQ(merge_shards(paths, &Tobs, &n), cumulative(T, N));
+    EXPECT_EQ(Tobs, T);
+    EXPECT_EQ(n, N);
+
+    // incomplete or duplicate
+    EXPECT_THROW(merge_shards({paths[0], paths[1]}), std::runtime_error);
+    EXPECT_THROW(merge_shards({paths[0], paths[1], paths[2], paths[1]}), std::runtime_error);
+
+    // different computation
+    cumulative_shard(T + 1, N, 2, nshards, paths[2]);
+    EXPECT_THROW(merge_shards(paths), std::runtime_error);
+
+    EXPECT_THROW(cumulative_shard(T, 0, 0, nshards, paths[0]), std::invalid_argument);
+    EXPECT_THROW(cumulative_shard(0, N, 0, nshards, paths[0]), std::invalid_argument);
+    EXPECT_THROW(cumulative_shard(-T, N, 0, nshards, paths[0]), std::invalid_argument);
+
+    for (const auto &p : paths)
+        std::remove(p.c_str());
+}
+
+TEST(squares_test, all_n)
+{
+    constexpr unsigned N = 50;
+    for (auto T : {3., 10., 30.})
+    {
+        const auto F = cumulatives(T, N);
+        ASSERT_EQ(F.size(), N + 1);
+        for (auto n = 1u; n <= N; ++n)
+            EXPECT_NEAR(F[n], cumulative(T, n), 1e-15) << " at T = " << T << ", n = " << n;
+    }
+}
+
+TEST(squares_test, precision)
+{
+    constexpr unsigned N = 60;
+    for (auto T : {3., 10., 30.})
+    {
+        const double exact = cumulative(T, N);
+        EXPECT_EQ(cumulative(T, N, Precision::extended), exact);
+        // a few ulp, not bit for bit
+        const double ulp = std::nextafter(exact, 2.0) - exact;
+        EXPECT_NEAR(cumulative(T, N, Precision::compensated), exact, 4 * ulp) << " at T = " << T;
+        EXPECT_NEAR(cumulative(T, N, Precision::fast), exact, 1e-12 * exact) << " at T = " << T;
+    }
+
+    // weights would underflow in double
+    EXPECT_EQ(cumulative(1e-8, N, Precision::fast), cumulative(1e-8, N));
+}
+
+TEST(squares_test, reproducible)
+{
+#ifdef _OPENMP
+    constexpr unsigned N = 60;
+    constexpr double T = 10;
+    const int nthreads = omp_get_max_threads();
+
+    omp_set_num_threads(1);
+    const double serial = cumulative(T, N);
+    double serial_bound;
+    const double serial_approx = cumulative(T, N, 1e-10, &serial_bound);
+
+    // bitwise identical for any number of threads
+    for (int n : {2, 3, 8})
+    {
+        omp_set_num_threads(n);
+        EXPECT_EQ(cumulative(T, N), serial) << " with " << n << " threads";
+        double bound;
+        EXPECT_EQ(cumulative(T, N, 1e-10, &bound), serial_approx) << " with " << n << " threads";
+        EXPECT_EQ(bound, serial_bound) << " with " << n << " threads";
+    }
+    omp_set_num_threads(nthreads);
+#endif
+}
+
+TEST(squares_test, executor)
+{
+    constexpr unsigned N = 40;
+    constexpr double T = 8;
+    const double expected = cumulative(T, N);
+    EXPECT_EQ(cumulative(T, N, serial()), expected);
+    EXPECT_EQ(cumulative(T, N, openmp()), expected);
+
+    // the caller decides how to run the tasks, here in reverse order
+    struct Reverse : public Executor
+    {
+        unsigned calls = 0, tasks = 0;
+        void parallel_for(unsigned n, const std::function<void(unsigned)> &task) override
+        {
+            ++calls;
+            tasks += n;
+            for (auto i = n; i > 0; --i)
+                task(i - 1);
+        }
+    } reverse;
+    EXPECT_EQ(cumulative(T, N, reverse), expected);
+    // the chi2 cache and the partition walk, one task per r each
+    EXPECT_EQ(reverse.calls, 2u);
+    EXPECT_EQ(reverse.tasks, 2 * N);
+
+    // the other entry points use it as well
+    EXPECT_EQ(pvalue(T, N, reverse), pvalue(T, N));
+    EXPECT_EQ(cumulatives(T, N, reverse).back(), expected);
+    EXPECT_EQ(cumulative(T, N, Precision::compensated, reverse), cumulative(T, N, Precision::compensated));
+    EXPECT_EQ(cumulative(T, N, 1e-12, nullptr, reverse), cumulative(T, N, 1e-12));
+    EXPECT_EQ(log_pvalue(T, N, reverse), log_pvalue(T, N));
+    EXPECT_EQ(reverse.calls, 12u);
+}
+
+TEST(squares_test, density)
+{
+    // N = 1: T is chi2 distributed with one degree of freedom
+    auto d = density(2.5, 1, true);
+    EXPECT_NEAR(d.F, gsl_cdf_chisq_P(2.5, 1), 1e-15);
+    EXPECT_NEAR(d.f, gsl_ran_chisq_pdf(2.5, 1), 1e-15);
+    EXPECT_NEAR(d.df, gsl_ran_chisq_pdf(2.5, 1) * (-0.5 / 2.5 - 0.5), 1e-15);
+
+    // compare with finite differences
+    constexpr unsigned N = 40;
+    for (auto T : {3., 10., 25.})
+    {
+        d = density(T, N, true);
+        EXPECT_EQ(d.F, cumulative(T, N));
+
+        constexpr double h = 1e-3;
+        const double Fp = cumulative(T + h, N);
+        const double Fm = cumulative(T - h, N);
+        EXPECT_NEAR(d.f, (Fp - Fm) / (2 * h), 1e-7) << " at T = " << T;
+        EXPECT_NEAR(d.df, (Fp - 2 * d.F + Fm) / (h * h), 1e-4) << " at T = " << T;
+    }
+
+    // without the second derivative
+    d = density(10, N);
+    EXPECT_EQ(d.F, cumulative(10, N));
+    EXPECT_TRUE(std::isnan(d.df));
+
+    // same result on any executor
+    const auto e = density(10, N, true, serial());
+    d = density(10, N, true);
+    EXPECT_EQ(e.F, d.F);
+    EXPECT_EQ(e.f, d.f);
+    EXPECT_EQ(e.df, d.df);
+}
+
+TEST(squares_test, log_pvalue)
+{
+    // N = 1, 2: all runs enumerated by hand, far beyond 1 - cumulative
+    for (auto T : {5., 50., 200.})
+    {
+        EXPECT_NEAR(log_pvalue(T, 1), std::log(gsl_cdf_chisq_Q(T, 1)), 1e-12);
+        const double p2 = (2 * gsl_cdf_chisq_Q(T, 1) + gsl_cdf_chisq_Q(T, 2)) / 3;
+        EXPECT_NEAR(log_pvalue(T, 2), std::log(p2), 1e-12) << " at T = " << T;
+    }
+
+    // agrees with pvalue while that has enough digits
+    constexpr unsigned N = 40;
+    for (auto T : {1., 10., 30.})
+        EXPECT_NEAR(std::exp(log_pvalue(T, N)) / pvalue(T, N), 1, 1e-9) << " at T = " << T;
+
+    // finite and decreasing in the far tail
+    double previous = 0;
+    for (auto T : {100., 300., 1000.})
+    {
+        const double lp = log_pvalue(T, N);
+        EXPECT_TRUE(std::isfinite(lp));
+        EXPECT_LT(lp, previous);
+        previous = lp;
+    }
+}
+
+TEST(squares_test, significant)
+{
+    constexpr unsigned N = 50;
+    constexpr double alpha = 1e-3;
+    for (auto T : {5., 15., 22., 25., 40.})
+    {
+        const double p = pvalue(T, N);
+        double lower, upper;
+        EXPECT_EQ(is_significant(T, N, alpha, &lower, &upper), p < alpha) << " at T = " << T;
+        EXPECT_LE(lower, p * (1 + 1e-12));
+        EXPECT_GE(upper, p * (1 - 1e-12));
+        EXPECT_TRUE(upper < alpha || lower >= alpha);
+    }
+
+    // far from alpha, the bounds suffice long before the exact value
+    double lower, upper;
+    EXPECT_FALSE(is_significant(5, N, alpha, &lower, &upper));
+    EXPECT_GT(upper - lower, 0.1);
+
+    // same bounds on any executor
+    double serial_lower, serial_upper;
+    EXPECT_EQ(is_significant(22, N, alpha, &serial_lower, &serial_upper, serial()),
+              is_significant(22, N, alpha, &lower, &upper));
+    EXPECT_EQ(serial_lower, lower);
+    EXPECT_EQ(serial_upper, upper);
+
+    // tiny alpha
+    EXPECT_TRUE(is_significant(100, N, 1e-15));
+    EXPECT_FALSE(is_significant(60, N, 1e-15));
+
+    EXPECT_THROW(is_significant(5, N, 0), std::invalid_argument);
+}
@@ -2,7 +2,11 @@
 #include "squares.h"
 #include "gtest/gtest.h"
 #include <gsl/gsl_cdf.h>
+#include <gsl/gsl_integration.h>
 #include <cmath>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 
 using namespace squares;
 
@@ -16,6 +20,8 @@ TEST(squares_approx_test, split)
     const double approx = F*F / (1.0 + Delta(Tobs, N, N));
 
     EXPECT_NEAR(approx, approx_cumulative(Tobs, N, n), 1e-15);
+    EXPECT_EQ(approx_cumulative(Tobs, N, n, EPSREL, EPSABS, serial()), approx_cumulative(Tobs, N, n));
+    EXPECT_EQ(approx_cumulative(Tobs, {N, N}, EPSREL, EPSABS, serial()), approx_cumulative(Tobs, {N, N}));
 }
 
 void test_on_grid(const unsigned K, const unsigned N, const unsigned n, const double eps=2e-7)
@@ -50,6 +56,64 @@ TEST(squares_approx_test, hH)
     EXPECT_NEAR(Delta(Tobs, N, N), 0.00175994, 1e-8);
 }
 
+TEST(squares_approx_test, Delta_batch)
+{
+    // unsorted, repeated, and widely spread values
+    const std::vector<double> Tobs{15.5, 0.3, 7, 15.5, 42, 3.3, 100};
+    for (auto N : {1u, 12u, 60u})
+    {
+        const auto D = Delta(Tobs, N, N + 3);
+        ASSERT_EQ(D.size(), Tobs.size());
+        for (auto i = 0u; i < Tobs.size(); ++i)
+        {
+            EXPECT_EQ(D[i], Delta(Tobs[i], N, N + 3)) << "N = " << N << ", Tobs = " << Tobs[i];
+        }
+    }
+    EXPECT_NEAR(Delta(std::vector<double>{15.5}, 12, 12)[0], 0.00175994, 1e-8);
+    EXPECT_TRUE(Delta(std::vector<double>{}, 12, 12).empty());
+
+    // same edge cases as the scalar version
+    const std::vector<double> edge{1, 0, -2};
+    const auto D = Delta(edge, 12, 12, EPSREL, EPSABS, serial());
+    for (auto i = 0u; i < edge.size(); ++i)
+        EXPECT_EQ(D[i], Delta(edge[i], 12, 12)) << "Tobs = " << edge[i];
+}
+
+TEST(squares_approx_test, Delta_closed)
+{
+    // the integral of h * H by adaptive quadrature
+    struct Data
+    {
+        double Tobs;
+        unsigned Nl, Nr;
+    };
+    gsl_function F;
+    F.function = [](double x, void *params)
+    {
+        const Data &d = *static_cast<Data *>(params);
+        return h(x, d.Nl) * H(d.Tobs - x, d.Tobs, d.Nr);
+    };
+    constexpr size_t limit = 1000;
+    gsl_integration_workspace *w = gsl_integration_workspace_alloc(limit);
+    for (auto N : {1u, 12u, 60u})
+    {
+        for (auto T : {0.3, 3.3, 15.5, 42.})
+        {
+            Data data{T, N, N + 3};
+            F.params = &data;
+            double result, error;
+            gsl_integration_qag(&F, 0, T, 0, 1e-12, limit, GSL_INTEG_GAUSS21, w, &result, &error);
+            EXPECT_NEAR(Delta(T, N, N + 3), result, 1e-10 * result) << "N = " << N << ", Tobs = " << T;
+        }
+    }
+    gsl_integration_workspace_free(w);
+
+    // far in the tail without cancellation: N = 1 by hand, P(T, 1)^2 - P(T, 2)
+    const double Q1 = gsl_cdf_chisq_Q(200, 1);
+    EXPECT_NEAR(Delta(200, 1, 1), 0.25 * (gsl_cdf_chisq_Q(200, 2) - 2 * Q1 + Q1 * Q1), 1e-12 * Delta(200, 1, 1));
+    EXPECT_GT(Delta(200, 1, 1), 0);
+}
+
 TEST(squares_approx_test, cdf)
 {
     EXPECT_NEAR(gsl_cdf_chisq_P(15.5, 12), 0.784775, 1e-6);
@@ -108,6 +172,114 @@ TEST(squares_approx_test, 2dcorrection)
     EXPECT_LE(corr, hi);
 }
 
+TEST(squares_approx_test, 2dcorrection_constant)
+{
+    // without interpolation, F(Tobs | Nl + Nr) is a constant factor
+    // and the integral over the triangle is Delta
+    constexpr double Tobs = 15.5;
+    constexpr unsigned N = 20;
+    for (auto Nr : {N, N + 3})
+    {
+        Subdivision subdivision;
+        const auto corr = full_correction(Tobs, N, Nr, 1e-7, 0.0, 0, &subdivision);
+        const auto expected = cumulative(Tobs, N + Nr) * Delta(Tobs, N, Nr);
+        EXPECT_NEAR(corr, expected, 1e-7 * expected) << "Nr = " << Nr;
+
+        // the singular vertices need no deep refinement, and only half
+        // of the triangle if symmetric
+        EXPECT_LT(subdivision.evaluations, (Nr == N) ? 5000u : 10000u) << "Nr = " << Nr;
+    }
+}
+
+TEST(squares_approx_test, warm_start)
+{
+    constexpr unsigned N = 20;
+    constexpr double epsrel = 1e-5;
+    Subdivision warm;
+    for (auto Tobs : {10., 11., 12., 13.})
+    {
+        Subdivision cold;
+        const auto expected = full_correction(Tobs, N, N, epsrel, 0.0, 20, &cold);
+        EXPECT_EQ(full_correction(Tobs, N, N, epsrel, 0.0, 20), expected);
+
+        const auto regions = warm.regions.size();
+        const auto corr = full_correction(Tobs, N, N, epsrel, 0.0, 20, &warm);
+        EXPECT_NEAR(corr, expected, 2 * epsrel * expected) << "Tobs = " << Tobs;
+        EXPECT_FALSE(warm.regions.empty());
+        if (regions)
+        {
+            EXPECT_LT(warm.evaluations, cold.evaluations) << "Tobs = " << Tobs;
+        }
+    }
+}
+
+TEST(squares_approx_test, interpolant)
+{
+    constexpr unsigned N = 40;
+    CumulativeInterpolant F(N, 1e-12);
+    EXPECT_EQ(F.nodes(), 0u);
+    for (double x = 5; x < 30; x += 0.37)
+        EXPECT_NEAR(F(x), cumulative(x, N), 1e-11) << "x = " << x;
+
+    // nothing new to compute in the same range
+    const auto nodes = F.nodes();
+    EXPECT_GT(nodes, 0u);
+    F(17.2);
+    EXPECT_EQ(F.nodes(), nodes);
+
+    // shared by threads, each extending the range
+    CumulativeInterpolant G(N, 1e-12);
+    std::vector<double> x, values(8);
+    for (auto i = 0u; i < values.size(); ++i)
+        x.push_back(5 + 4.5 * i);
+    std::vector<std::thread> threads;
+    for (auto i = 0u; i < values.size(); ++i)
+        threads.emplace_back([&, i]() { values[i] = G(x[i]); });
+    for (auto &t : threads)
+        t.join();
+    for (auto i = 0u; i < values.size(); ++i)
+        EXPECT_EQ(values[i], F(x[i])) << "x = " << x[i];
+
+    // on the caller's executor
+    CumulativeInterpolant S(N, 1e-12, 2, serial());
+    EXPECT_EQ(S(17.2), F(17.2));
+
+    // threads that need the same cell build it only once
+    CumulativeInterpolant H(N, 1e-12);
+    threads.clear();
+    for (auto i = 0u; i < values.size(); ++i)
+        threads.emplace_back([&, i]() { values[i] = H(10.1 + 0.2 * i); });
+    for (auto &t : threads)
+        t.join();
+    CumulativeInterpolant K(N, 1e-12);
+    K(10.1);
+    EXPECT_EQ(H.nodes(), K.nodes());
+
+    EXPECT_THROW(F(0), std::invalid_argument);
+    EXPECT_THROW(CumulativeInterpolant(N, 0), std::invalid_argument);
+}
+
+TEST(squares_approx_test, 2dcorrection_interpolant)
+{
+    constexpr double Tobs = 15.5;
+    constexpr unsigned N = 20;
+    constexpr double epsrel = 1e-6;
+    CumulativeInterpolant F(2 * N);
+
+    // the linear interpolation converges slowly towards the same value
+    Subdivision smooth, linear;
+    const auto corr = full_correction(Tobs, N, N, F, epsrel, 0.0, &smooth);
+    EXPECT_NEAR(corr, full_correction(Tobs, N, N, epsrel, 0.0, 50, &linear), 2e-5 * corr);
+    EXPECT_LT(smooth.evaluations, linear.evaluations);
+
+    // reused for the next Tobs, only the new range is computed
+    const auto nodes = F.nodes();
+    full_correction(Tobs + 1, N, N, F, epsrel);
+    EXPECT_LT(F.nodes(), 2 * nodes);
+
+    EXPECT_THROW(full_correction(Tobs, N, N + 1, F), std::invalid_argument);
+}
+
 TEST(squares_approx_test, paper_timing)
 {
     constexpr double Tobs = 15.8;
@@ -115,3 +287,51 @@ TEST(squares_approx_test, paper_timing)
     // don't care about result, just want to measure the time
     pvalue(Tobs, N);
 }
+
+TEST(squares_approx_test, auto)
+{
+    constexpr double Tobs = 10;
+
+    // fast enough for exact
+    AutoChoice choice;
+    EXPECT_EQ(pvalue_auto(Tobs, 30, 1e-6, 10, &choice), pvalue(Tobs, 30));
+    EXPECT_EQ(choice.N, 30u);
+    EXPECT_EQ(choice.n, 1);
+    EXPECT_EQ(choice.error, 0);
+    EXPECT_EQ(choice.extrapolated, 0);
+    EXPECT_TRUE(choice.converged);
+
+    // no time: shortest chunk, but the error estimate holds
+    constexpr unsigned N = 60;
+    const double p = pvalue_auto(Tobs, N, 1e-12, 0, &choice);
+    EXPECT_LT(choice.N, N);
+    EXPECT_FALSE(choice.converged);
+    EXPECT_GT(choice.error, 0);
+    EXPECT_NEAR(p, approx_pvalue(Tobs, choice.N, choice.n), 1e-13);
+    EXPECT_LE(std::abs(p - pvalue(Tobs, N)), choice.error);
+
+    // far too long for exact
+    const double q = pvalue_auto(Tobs, 1000, 3e-3, 10, &choice);
+    EXPECT_TRUE(choice.converged);
+    EXPECT_LE(choice.error, 3e-3);
+    EXPECT_GT(choice.n, 1);
+    EXPECT_NEAR(q, approx_pvalue(Tobs, choice.N, choice.n), 1e-13);
+}
+
+TEST(squares_approx_test, chunks)
+{
+    EXPECT_EQ(chunks(355, 89), std::vector<unsigned>({89, 89, 89, 88}));
+    EXPECT_EQ(chunks(10, 100), std::vector<unsigned>({10}));
+    EXPECT_EQ(chunks(12, 3), std::vector<unsigned>({3, 3, 3, 3}));
+
+    // same as identical chunks
+    constexpr double Tobs = 25;
+    EXPECT_NEAR(approx_cumulative(Tobs, {40, 40}), approx_cumulative(Tobs, 40, 2), 1e-15);
+
+    // unequal chunks
+    EXPECT_NEAR(approx_cumulative(Tobs, {30, 50}), cumulative(Tobs, 80), 2e-7);
+    EXPECT_NEAR(approx_cumulative(Tobs, {50, 30}), cumulative(Tobs, 80), 2e-7);
+
+    // instead of interpolating between 4*88 and 4*89, see above
+    EXPECT_NEAR(approx_cumulative(32, chunks(355, 89)), approx_cumulative(32, 71, 5), 3e-9);
+}
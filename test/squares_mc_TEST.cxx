@@ -0,0 +1,148 @@
+#include "squares_mc.h"
+#include "squares.h"
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+using namespace squares;
+
+TEST(squares_mc_test, statistic)
+{
+    const double z[] = {1, -1, 2, 1, 0, 3, -0.5};
+    EXPECT_EQ(statistic(z, 7), 9);
+    EXPECT_EQ(statistic(z, 5), 5);
+    EXPECT_EQ(statistic(z, 2), 1);
+
+    // two sequences of three bins, interleaved
+    const double zz[] = {1, -1,
+                         2, 2,
+                         -3, 2};
+    double T[2];
+    statistic(zz, 3, 2, T);
+    EXPECT_EQ(T[0], 5);
+    EXPECT_EQ(T[1], 8);
+}
+
+TEST(squares_mc_test, background)
+{
+    constexpr unsigned N = 20;
+    constexpr unsigned long nexp = 20000;
+    const auto T = simulate(std::vector<double>(N, 0), nexp, 1);
+    ASSERT_EQ(T.size(), nexp);
+
+    // reproducible for any executor
+    EXPECT_EQ(simulate(std::vector<double>(N, 0), nexp, 1, serial()), T);
+    EXPECT_NE(simulate(std::vector<double>(N, 0), nexp, 2), T);
+
+    // distributed according to the cumulative
+    for (auto t : {3., 6., 10.})
+    {
+        double below = 0;
+        for (auto x : T)
+            below += x < t;
+        below /= nexp;
+        const double F = cumulative(t, N);
+        EXPECT_NEAR(below, F, 4 * std::sqrt(F * (1 - F) / nexp)) << " at T = " << t;
+    }
+
+    // with the true cumulative, the power equals the significance level
+    unsigned calls = 0;
+    const std::vector<double> alpha{0.5, 0.1, 0.01};
+    const auto p = power(T, [&](double t) { ++calls; return cumulative(t, N); }, alpha);
+    EXPECT_NEAR(p[0], 0.5, 0.02);
+    EXPECT_NEAR(p[1], 0.1, 0.01);
+    EXPECT_NEAR(p[2], 0.01, 0.003);
+    // binary search in the simulated T
+    EXPECT_LE(calls, alpha.size() * (std::log2(nexp) + 1));
+
+    // same as counting T above the critical values
+    for (auto i = 0u; i < alpha.size(); ++i)
+    {
+        const double t = critical_value([](double x) { return cumulative(x, N); }, alpha[i], 1e-12);
+        EXPECT_NEAR(p[i], double(std::count_if(T.begin(), T.end(), [&](double x) { return x >= t; })) / nexp,
+                    1.0 / nexp);
+    }
+}
+
+TEST(squares_mc_test, signal)
+{
+    constexpr unsigned N = 30;
+    constexpr unsigned long nexp = 5000;
+    const auto F = [](double t) { return cumulative(t, N); };
+    const std::vector<double> alpha{0.1, 0.01};
+
+    const auto weak = power(simulate(gaussian_bump(N, 1, 15, 2), nexp), F, alpha);
+    const auto strong = power(simulate(gaussian_bump(N, 2, 15, 2), nexp), F, alpha);
+    for (auto i = 0u; i < alpha.size(); ++i)
+    {
+        EXPECT_GT(weak[i], alpha[i]);
+        EXPECT_GT(strong[i], weak[i]);
+    }
+
+    // bump at a random position but reproducible
+    const Signal random = [](unsigned long k, std::vector<double> &shift)
+    {
+        shift = gaussian_bump(N, 2, k % N, 2);
+    };
+    const auto T = simulate(N, random, nexp, 3);
+    EXPECT_EQ(simulate(N, random, nexp, 3, serial()), T);
+    EXPECT_GT(power(T, F, alpha)[0], alpha[0]);
+
+    // errors in the parallel loop reach the caller
+    const Signal wrong = [](unsigned long k, std::vector<double> &shift)
+    {
+        shift.assign((k == 3000) ? N + 1 : N, 0);
+    };
+    EXPECT_THROW(simulate(N, wrong, nexp), std::invalid_argument);
+}
+
+TEST(squares_mc_test, importance)
+{
+    constexpr unsigned long nexp = 20000;
+    for (auto N : {20u, 40u})
+    {
+        for (auto Tobs : {20., 50.})
+        {
+            const double exact = pvalue(Tobs, N);
+            const auto e = importance_pvalue(Tobs, N, nexp, 1, 1);
+            EXPECT_NEAR(e.value, exact, 4 * e.error) << "N = " << N << ", Tobs = " << Tobs;
+            EXPECT_LT(e.error, 0.2 * exact);
+        }
+    }
+
+    // reproducible for any executor and tilt is tunable
+    const auto e = importance_pvalue(50, 20, nexp, 0.9, 2);
+    const auto e2 = importance_pvalue(50, 20, nexp, 0.9, 2, serial());
+    EXPECT_EQ(e.value, e2.value);
+    EXPECT_EQ(e.error, e2.error);
+    EXPECT_NEAR(e.value, pvalue(50, 20), 4 * e.error);
+
+    EXPECT_THROW(importance_pvalue(50, 20, nexp, 0), std::invalid_argument);
+}
+
+TEST(squares_mc_test, qmc)
+{
+    constexpr unsigned N = 10;
+    constexpr double Tobs = 5;
+    constexpr unsigned long npoints = 4096;
+    constexpr unsigned nreplicas = 16;
+    const double exact = pvalue(Tobs, N);
+
+    const auto e = qmc_pvalue(Tobs, N, npoints, nreplicas, 1);
+    EXPECT_NEAR(e.value, exact, 4 * e.error);
+
+    // better than plain Monte Carlo with as many experiments
+    EXPECT_LT(e.error, std::sqrt(exact * (1 - exact) / (npoints * nreplicas)));
+
+    const auto e2 = qmc_pvalue(Tobs, N, npoints, nreplicas, 1, serial());
+    EXPECT_EQ(e.value, e2.value);
+    EXPECT_EQ(e.error, e2.error);
+
+    // other replicas, larger N
+    const auto e3 = qmc_pvalue(10, 50, npoints, 8, 2);
+    EXPECT_NE(e3.value, e.value);
+    EXPECT_NEAR(e3.value, pvalue(10, 50), 4 * e3.error);
+}
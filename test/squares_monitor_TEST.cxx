@@ -0,0 +1,64 @@
+#include "squares_monitor.h"
+#include "squares.h"
+#include "squares_approx.h"
+#include "gtest/gtest.h"
+
+#include <algorithm>
+
+using namespace squares;
+
+TEST(squares_monitor_test, grow)
+{
+    constexpr unsigned Nexact = 30;
+    constexpr unsigned N = 45;
+    const double x[N] = {0.3, -1.2, 1.1, 0.8, -0.1, 1.7, -0.4, -2.0, 0.9, 0.2,
+                         1.3, 1.0, 0.6, -0.5, 0.1, -0.9, 2.1, 0.4, -1.1, -0.3,
+                         0.7, 1.2, 0.5, -0.6, 0.3, 0.8, -1.4, 1.5, 0.2, -0.7,
+                         0.9, 0.6, 1.1, 0.4, -0.2, 0.3, 1.6, 0.5, -0.8, 0.1,
+                         2.2, 0.3, -1.0, 0.4, 1.0};
+    const double mu = 0.1;
+    const double sigma = 0.9;
+
+    Monitor m(Nexact);
+    Monitor serial_monitor(Nexact, EPSREL, EPSABS, serial());
+    for (auto i = 0u; i < N; ++i)
+    {
+        const double p = m.add(x[i], mu, sigma);
+        ASSERT_EQ(m.N(), i + 1);
+        EXPECT_EQ(serial_monitor.add(x[i], mu, sigma), p);
+
+        // brute force: largest chi2 of any run of successes
+        double T = 0;
+        for (auto b = 0u; b <= i; ++b)
+        {
+            double chi2 = 0;
+            for (auto e = b; e <= i && x[e] > mu; ++e)
+            {
+                chi2 += (x[e] - mu) * (x[e] - mu) / sigma / sigma;
+                T = std::max(T, chi2);
+            }
+        }
+        EXPECT_NEAR(m.Tobs(), T, 1e-13);
+
+        double chi2 = 0;
+        for (auto e = m.run_begin(); e < m.run_end(); ++e)
+        {
+            ASSERT_GT(x[e], mu);
+            chi2 += (x[e] - mu) * (x[e] - mu) / sigma / sigma;
+        }
+        EXPECT_NEAR(chi2, m.Tobs(), 1e-13);
+
+        if (m.N() <= Nexact)
+        {
+            EXPECT_FALSE(m.approximate());
+            EXPECT_NEAR(p, pvalue(m.Tobs(), m.N()), 1e-14) << " at N = " << m.N();
+        }
+        else
+        {
+            EXPECT_TRUE(m.approximate());
+            EXPECT_NEAR(p, approx_pvalue(m.Tobs(), Nexact, double(m.N()) / Nexact), 1e-14) << " at N = " << m.N();
+        }
+        EXPECT_EQ(m.pvalue(), p);
+        EXPECT_DOUBLE_EQ(m.cumulative(), 1 - p);
+    }
+}
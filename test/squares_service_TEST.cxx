@@ -0,0 +1,118 @@
+#include "squares_service.h"
+#include "squares.h"
+#include "squares_approx.h"
+#include "gtest/gtest.h"
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace squares;
+
+TEST(squares_service_test, cache)
+{
+    ThreadPool pool(2);
+    QueryCache cache(2, pool);
+
+    const Query a{Query::cdf, 5.0, 10, 1};
+    const Query b{Query::pval, 5.0, 10, 1};
+    const Query c{Query::cdf, 7.0, 10, 1};
+
+    // identical queries in one batch are only evaluated once
+    const auto res = cache({a, b, a});
+    EXPECT_EQ(res[0], cumulative(5.0, 10));
+    EXPECT_EQ(res[1], pvalue(5.0, 10));
+    EXPECT_EQ(res[2], res[0]);
+    EXPECT_EQ(cache.misses(), 2u);
+    EXPECT_EQ(cache.hits(), 1u);
+    EXPECT_EQ(cache.size(), 2u);
+
+    // evict the least recently used, that is `b`
+    cache(a);
+    cache(c);
+    EXPECT_EQ(cache.size(), 2u);
+    EXPECT_EQ(cache.misses(), 3u);
+    cache(a);
+    EXPECT_EQ(cache.misses(), 3u);
+    cache(b);
+    EXPECT_EQ(cache.misses(), 4u);
+
+    // `n` is irrelevant for exact queries
+    cache(Query{Query::pval, 5.0, 10, 3});
+    EXPECT_EQ(cache.misses(), 4u);
+}
+
+TEST(squares_service_test, executor)
+{
+    constexpr unsigned N = 40;
+    const double expected = cumulative(8, N);
+
+    ThreadPool pool(3);
+    EXPECT_EQ(cumulative(8, N, pool), expected);
+
+    // nested: every worker is busy with an outer task and waits for the inner loop
+    std::vector<double> res(6);
+    pool.parallel_for(res.size(), [&](unsigned i) { res[i] = cumulative(8, N, pool); });
+    for (auto x : res)
+        EXPECT_EQ(x, expected);
+
+    // exceptions are passed on to the caller
+    EXPECT_THROW(pool.parallel_for(10, [](unsigned i) { if (i == 7) throw std::runtime_error("7"); }),
+                 std::runtime_error);
+}
+
+TEST(squares_service_test, socket)
+{
+    const std::string path = "/tmp/squares_test_" + std::to_string(getpid()) + ".sock";
+    std::thread server([&] { serve(path, 100, 2, 20); });
+
+    const std::vector<Query> queries{{Query::cdf, 3.3, 10, 1},
+                                     {Query::pval, 15.5, 5, 1},
+                                     {Query::approx, 15.5, 12, 2}};
+
+    // wait for the server to come up
+    std::vector<double> res;
+    for (int i = 0; i < 100 && res.empty(); ++i)
+    {
+        try
+        {
+            res = remote(path, queries);
+        }
+        catch (const std::runtime_error &)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+
+    // exact transfer of doubles
+    ASSERT_EQ(res.size(), queries.size());
+    EXPECT_EQ(res[0], cumulative(3.3, 10));
+    EXPECT_EQ(res[1], pvalue(15.5, 5));
+    EXPECT_EQ(res[2], approx_cumulative(15.5, 12, 2));
+
+    // answered from cache
+    EXPECT_EQ(remote(path, queries), res);
+
+    // more clients at once than connection threads
+    std::vector<std::vector<double>> replies(8);
+    std::vector<std::thread> clients;
+    for (auto &r : replies)
+        clients.emplace_back([&] { r = remote(path, queries); });
+    for (auto &c : clients)
+        c.join();
+    for (const auto &r : replies)
+        EXPECT_EQ(r, res);
+
+    // invalid queries are answered with an error
+    EXPECT_THROW(remote(path, {{Query::cdf, 3.3, 21, 1}}), std::runtime_error);
+    EXPECT_THROW(remote(path, {{Query::cdf, std::numeric_limits<double>::infinity(), 10, 1}}), std::runtime_error);
+    EXPECT_THROW(remote(path, {{Query::approx, 3.3, 10, std::nan("")}}), std::runtime_error);
+
+    shutdown(path);
+    server.join();
+}
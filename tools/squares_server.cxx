@@ -0,0 +1,33 @@
+// Copyright 2018 Frederik Beaujean <beaujean@mpp.mpg.de>
+
+// Answer p-value queries of several processes on one node from a common cache.
+//
+// Usage: squares_server [socket [capacity [nthreads [max_N]]]]
+
+#include "squares_service.h"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+
+int main(int argc, char *argv[])
+{
+    const std::string path = (argc > 1) ? argv[1] : "/tmp/squares.sock";
+    const std::size_t capacity = (argc > 2) ? std::strtoul(argv[2], nullptr, 10) : 10000;
+    const unsigned nthreads = (argc > 3) ? std::strtoul(argv[3], nullptr, 10) : 0;
+    const unsigned max_N = (argc > 4) ? std::strtoul(argv[4], nullptr, 10) : 100;
+
+    try
+    {
+        std::cout << "Listening on " << path << std::endl;
+        squares::serve(path, capacity, nthreads, max_N);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
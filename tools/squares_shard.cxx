@@ -0,0 +1,82 @@
+// Copyright 2018 Frederik Beaujean <beaujean@mpp.mpg.de>
+
+// Split the exact cumulative over several processes and merge the results.
+//
+// Usage: squares_shard run Tobs N shard nshards output
+//        squares_shard merge input...
+
+#include "squares.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+int usage()
+{
+    std::cerr << "Usage: squares_shard run Tobs N shard nshards output\n"
+              << "       squares_shard merge input..." << std::endl;
+    return 2;
+}
+
+/// Parse the whole of `s` or throw
+double to_double(const char *s)
+{
+    char *end;
+    const double x = std::strtod(s, &end);
+    if (end == s || *end != '\0')
+        throw std::invalid_argument(std::string("Not a number: ") + s);
+    return x;
+}
+
+unsigned to_unsigned(const char *s)
+{
+    char *end;
+    const unsigned long x = std::strtoul(s, &end, 10);
+    if (end == s || *end != '\0' || *s == '-' || x > std::numeric_limits<unsigned>::max())
+        throw std::invalid_argument(std::string("Not an unsigned integer: ") + s);
+    return x;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        if (argc == 7 && std::strcmp(argv[1], "run") == 0)
+        {
+            squares::cumulative_shard(to_double(argv[2]), to_unsigned(argv[3]), to_unsigned(argv[4]),
+                                      to_unsigned(argv[5]), argv[6]);
+            return 0;
+        }
+        if (argc >= 3 && std::strcmp(argv[1], "merge") == 0)
+        {
+            double Tobs;
+            unsigned N;
+            const double F = squares::merge_shards(std::vector<std::string>(argv + 2, argv + argc), &Tobs, &N);
+            std::printf("Tobs = %.17g N = %u F = %.17g p = %.17g\n", Tobs, N, F, 1 - F);
+            return 0;
+        }
+    }
+    catch (const std::invalid_argument &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return usage();
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return usage();
+}